@@ -0,0 +1,36 @@
+#version 330 core
+in vec2 TexCoords;
+out vec4 color;
+
+// one direction of a separable gaussian blur, VERTICAL selects
+// the axis at compile time
+
+#define MAX_TAPS 16
+
+uniform sampler2D image;
+
+// the taps sample between two texels, the bilinear filter blends
+// them with the weights of the discrete kernel; the offsets are in
+// texels of the image
+uniform int taps;
+uniform float offsets[MAX_TAPS];
+uniform float weights[MAX_TAPS];
+
+#if defined(VERTICAL)
+const vec2 axis = vec2(0.0, 1.0);
+#else
+const vec2 axis = vec2(1.0, 0.0);
+#endif
+
+void main()
+{
+	vec2 pos = sceneCoords(image, TexCoords);
+	vec2 texel = axis / vec2(textureSize(image, 0));
+	vec3 sum = texture(image, pos).rgb * weights[0];
+	for (int i = 1; i < taps; i++) {
+		vec2 offset = texel * offsets[i];
+		sum += texture(image, clampScene(image, pos + offset)).rgb * weights[i];
+		sum += texture(image, clampScene(image, pos - offset)).rgb * weights[i];
+	}
+	color = vec4(sum, 1.0);
+}
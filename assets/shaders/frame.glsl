@@ -0,0 +1,23 @@
+// prepended to every shader after the #version line and the defines
+
+layout (std140) uniform Frame
+{
+	mat4 projection;
+	float time;
+	// part of the postprocess targets covered by the scene
+	vec2 sceneScale;
+};
+
+// the scene is drawn in a corner of the textures, the samples stay
+// half a texel inside it on every side: the bilinear filter would
+// blend in the stale texels around it or wrap to the far edge
+vec2 clampScene(sampler2D source, vec2 pos)
+{
+	vec2 margin = 0.5 / vec2(textureSize(source, 0));
+	return clamp(pos, margin, sceneScale - margin);
+}
+
+vec2 sceneCoords(sampler2D source, vec2 uv)
+{
+	return clampScene(source, clamp(uv, 0.0, 1.0) * sceneScale);
+}
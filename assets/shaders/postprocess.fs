@@ -2,39 +2,76 @@
 in vec2 TexCoords;
 out vec4 color;
 
+// the effects are selected at compile time: CHAOS, CONFUSE, SHAKE
+// and the FXAA antialiasing
+
 uniform sampler2D scene;
 
+// alone, SHAKE reads the scene blurred by the earlier passes
+#if defined(CHAOS)
 uniform vec2 offsets[9];
 uniform int edge_kernel[9];
-uniform float blur_kernel[9];
+#endif
 
-uniform bool chaos;
-uniform bool confuse;
-uniform bool shake;
+#if defined(FXAA) && (defined(CONFUSE) || !defined(SHAKE))
+#define FXAA_SPAN_MAX 8.0
+#define FXAA_REDUCE_MUL (1.0 / 8.0)
+#define FXAA_REDUCE_MIN (1.0 / 128.0)
 
-void main()
+const vec3 luma = vec3(0.299, 0.587, 0.114);
+
+// the edges of CHAOS and the blurred SHAKE skip it
+//
+// FXAA after Timothy Lottes: the luma of the corners gives the
+// direction of the edge, the scene is blended along it unless the
+// result leaves the local luma range
+vec3 sampleScene(vec2 uv)
 {
-	vec3 mysample[9];
-	if (chaos || shake) {
-		for (int i = 0; i < 9; i++)
-			mysample[i] = vec3(texture(scene, TexCoords.st + offsets[i]));
-	}
+	vec2 texel = 1.0 / vec2(textureSize(scene, 0));
+	vec2 pos = sceneCoords(scene, uv);
+	vec3 rgbM = texture(scene, pos).rgb;
+	float lumaNW = dot(texture(scene, clampScene(scene, pos + vec2(-1.0, -1.0) * texel)).rgb, luma);
+	float lumaNE = dot(texture(scene, clampScene(scene, pos + vec2( 1.0, -1.0) * texel)).rgb, luma);
+	float lumaSW = dot(texture(scene, clampScene(scene, pos + vec2(-1.0,  1.0) * texel)).rgb, luma);
+	float lumaSE = dot(texture(scene, clampScene(scene, pos + vec2( 1.0,  1.0) * texel)).rgb, luma);
+	float lumaM = dot(rgbM, luma);
+	float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+	float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+	vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)),
+	                 ((lumaNW + lumaSW) - (lumaNE + lumaSE)));
+	float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * FXAA_REDUCE_MUL,
+	                   FXAA_REDUCE_MIN);
+	float scale = 1.0 / (min(abs(dir.x), abs(dir.y)) + reduce);
+	dir = clamp(dir * scale, -FXAA_SPAN_MAX, FXAA_SPAN_MAX) * texel;
 
-	if (chaos) {
-		color = vec4(0.0);
-		for (int i = 0; i < 9; i++) {
-			color += vec4(mysample[i] * edge_kernel[i], 0.0);
-		}
-		color.a = 1.0f;
-	} else if (confuse) {
-		color = vec4(1.0 - texture(scene, TexCoords).rgb, 1.0);
-	} else if (shake) {
-		color = vec4(0.0);
-		for (int i = 0; i < 9; i++) {
-			color += vec4(mysample[i] * blur_kernel[i], 0.0f);
-		}
-		color.a = 1.0f;
-	} else {
-		color = texture(scene, TexCoords);
+	vec3 rgbA = 0.5 * (texture(scene, clampScene(scene, pos + dir * (1.0 / 3.0 - 0.5))).rgb +
+	                   texture(scene, clampScene(scene, pos + dir * (2.0 / 3.0 - 0.5))).rgb);
+	vec3 rgbB = rgbA * 0.5 + 0.25 * (texture(scene, clampScene(scene, pos - dir * 0.5)).rgb +
+	                                 texture(scene, clampScene(scene, pos + dir * 0.5)).rgb);
+	float lumaB = dot(rgbB, luma);
+	return lumaB < lumaMin || lumaB > lumaMax ? rgbA : rgbB;
+}
+#else
+vec3 sampleScene(vec2 uv)
+{
+	return texture(scene, sceneCoords(scene, uv)).rgb;
+}
+#endif
+
+void main()
+{
+#if defined(CHAOS)
+	color = vec4(0.0);
+	for (int i = 0; i < 9; i++) {
+		vec2 uv = fract(TexCoords.st + offsets[i]);
+		vec3 s = texture(scene, sceneCoords(scene, uv)).rgb;
+		color += vec4(s * edge_kernel[i], 0.0);
 	}
+	color.a = 1.0f;
+#elif defined(CONFUSE)
+	color = vec4(1.0 - sampleScene(TexCoords), 1.0);
+#else
+	color = vec4(sampleScene(TexCoords), 1.0);
+#endif
 }
@@ -3,29 +3,26 @@ layout (location = 0) in vec4 vertex; /* <vec2 position, vec2 texcoords> */
 
 out vec2 TexCoords;
 
-uniform bool chaos;
-uniform bool confuse;
-uniform bool shake;
-uniform float time;
+// the effects are selected at compile time: CHAOS, CONFUSE, SHAKE
 
 void main()
 {
 	gl_Position = vec4(vertex.xy, 0.0f, 1.0f);
 	vec2 texture = vertex.zw;
 
-	if (chaos) {
-		float strength = 0.3;
-		TexCoords = vec2(texture.x + sin(time) * strength,
-				 texture.y + cos(time) * strength);
-	} else if (confuse) {
-		TexCoords = vec2(1.0 - texture.x, 1.0 - texture.y);
-	} else {
-		TexCoords = texture;
-	}
+#if defined(CHAOS)
+	float strength = 0.3;
+	TexCoords = vec2(texture.x + sin(time) * strength,
+			 texture.y + cos(time) * strength);
+#elif defined(CONFUSE)
+	TexCoords = vec2(1.0 - texture.x, 1.0 - texture.y);
+#else
+	TexCoords = texture;
+#endif
 
-	if (shake) {
-		float strength = 0.01;
-		gl_Position.x += cos(time * 10) * strength;
-		gl_Position.y += cos(time * 15) * strength;
-	}
+#if defined(SHAKE)
+	float shakeStrength = 0.01;
+	gl_Position.x += cos(time * 10) * shakeStrength;
+	gl_Position.y += cos(time * 15) * shakeStrength;
+#endif
 }
@@ -0,0 +1,21 @@
+#version 330 core
+in vec2 TexCoords; /* level coordinates in tiles */
+in vec4 VertexColor;
+out vec4 color;
+
+uniform sampler2D image; /* atlas of the blocks */
+uniform sampler2D tiles; /* one texel per block, 0 for empty */
+uniform vec4 tileRect; /* origin and size of a tile in the atlas */
+
+void main()
+{
+	ivec2 cell = ivec2(floor(TexCoords));
+	int type = int(texelFetch(tiles, cell, 0).r * 255.0 + 0.5);
+	if (type == 0) {
+		discard;
+	}
+
+	vec2 uv = tileRect.xy + vec2(float(type) + fract(TexCoords.x),
+				     fract(TexCoords.y)) * tileRect.zw;
+	color = texture(image, uv) * VertexColor;
+}
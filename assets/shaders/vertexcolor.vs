@@ -5,8 +5,6 @@ layout (location = 1) in vec4 color;
 out vec2 TexCoords;
 out vec4 VertexColor;
 
-uniform mat4 projection;
-
 void main()
 {
 	TexCoords = vertex.zw;
@@ -6,10 +6,19 @@
 #include <al.h>
 #include <alc.h>
 
-#ifndef NDEBUG
+#include "errorcheck.hpp"
+
+#if ERROR_CHECK_LEVEL == ERROR_CHECK_SYNC
 #define alCheck(expr) do { expr; alCheckError(__FILE__, __LINE__, #expr); } while (0)
+#define alCheckPending() do { } while (0)
+#elif ERROR_CHECK_LEVEL == ERROR_CHECK_CALLBACK
+// OpenAL has no message callback: the errors of the frame are
+// collected at once by alCheckPending()
+#define alCheck(expr) do { expr; } while (0)
+#define alCheckPending() alCheckError(__FILE__, __LINE__, "pending errors")
 #else
 #define alCheck(expr) do { expr; } while (0)
+#define alCheckPending() do { } while (0)
 #endif
 
 void alCheckError(const std::filesystem::path &file, unsigned line, std::string_view expr);
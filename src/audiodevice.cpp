@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include "alcheck.hpp"
+#include "cpuprofiler.hpp"
 #include "audiodevice.hpp"
 
 namespace
@@ -131,6 +132,12 @@ AudioDevice::close()
 	}
 }
 
+bool
+AudioDevice::isOpen() const
+{
+	return mAudioContext != nullptr;
+}
+
 float
 AudioDevice::getMasterVolume() const
 {
@@ -160,6 +167,11 @@ AudioDevice::setMasterVolume(float value)
 void
 AudioDevice::play(SoundID soundId)
 {
+	if (!isOpen())
+	{
+		return;
+	}
+
         // find the sound id
 	auto found = mBuffers.find(soundId);
 	if (found == mBuffers.end())
@@ -190,6 +202,12 @@ AudioDevice::play(SoundID soundId)
 void
 AudioDevice::update()
 {
+	PROFILE_ZONE("AudioDevice::update");
+	if (!isOpen())
+	{
+		return;
+	}
+
 	// NOTE: removing elements invalidates references, pointers
 	// and iterators that refer to the following elements: we are
 	// safe since pop_back() removes previous elements.
@@ -205,6 +223,13 @@ AudioDevice::update()
 			mPlayingSources.pop_back();
 		}
 	}
+	alCheckPending();
+}
+
+std::size_t
+AudioDevice::getActiveSources() const
+{
+	return mPlayingSources.size();
 }
 
 static unsigned
@@ -20,12 +20,14 @@ public:
 
 	bool open(const std::string &name);
 	void close();
+	bool isOpen() const;
 
 	float getMasterVolume() const;
 	void setMasterVolume(float value);
 
 	void play(SoundID id);
 	void update();
+	std::size_t getActiveSources() const;
 
 	bool load(SoundID id, const std::filesystem::path &path);
 
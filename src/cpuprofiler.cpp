@@ -0,0 +1,263 @@
+#include "cpuprofiler.hpp"
+
+#if CPU_PROFILER
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// zones kept per thread: a capture cannot be longer than that
+static constexpr std::size_t Capacity = 1 << 16;
+
+struct Event
+{
+	const char *name;
+	std::int64_t start;
+	std::int64_t duration;
+};
+
+// slot of the ring, its fields are atomic since the capture may
+// read a slot while its thread overwrites it
+struct EventSlot
+{
+	std::atomic<const char *> name;
+	std::atomic<std::int64_t> start;
+	std::atomic<std::int64_t> duration;
+};
+
+// ring written only by its thread, without locks; the capture
+// reads the entries published by the write index and checks it
+// again afterwards, like a seqlock
+struct ThreadBuffer
+{
+	std::string name;
+	unsigned id;
+	std::unique_ptr<EventSlot[]> events;
+	std::atomic<std::size_t> write;
+};
+
+struct Capture
+{
+	std::filesystem::path path;
+	unsigned frames = 0;
+	bool started = false;
+	std::int64_t start = 0;
+	std::vector<std::int64_t> frameMarks;
+};
+
+// copy of the zones of a capture, written away from the frame
+struct Trace
+{
+	struct Thread
+	{
+		unsigned id;
+		std::string name;
+	};
+
+	struct ThreadEvent
+	{
+		unsigned thread;
+		Event event;
+	};
+
+	std::filesystem::path path;
+	std::vector<Thread> threads;
+	std::vector<ThreadEvent> events;
+	std::vector<std::int64_t> frameMarks;
+};
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+thread_local ThreadBuffer *threadBuffer = nullptr;
+
+std::mutex captureMutex;
+std::atomic<bool> capturing = false;
+Capture current;
+
+static std::int64_t
+now()
+{
+	static const auto epoch = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - epoch).count();
+}
+
+static ThreadBuffer &
+getThreadBuffer()
+{
+	if (!threadBuffer)
+	{
+		auto buffer = std::make_unique<ThreadBuffer>();
+		buffer->events = std::make_unique<EventSlot[]>(Capacity);
+		buffer->write = 0;
+
+		std::lock_guard lock(registryMutex);
+		buffer->id = buffers.size() + 1;
+		buffer->name = "thread " + std::to_string(buffer->id);
+		threadBuffer = buffers.emplace_back(std::move(buffer)).get();
+	}
+	return *threadBuffer;
+}
+
+static Trace
+collectTrace(const Capture &c, std::int64_t end)
+{
+	Trace trace;
+	trace.path = c.path;
+	trace.frameMarks = c.frameMarks;
+
+	std::vector<Event> ring;
+	std::lock_guard lock(registryMutex);
+	for (const auto &b : buffers)
+	{
+		trace.threads.push_back({b->id, b->name});
+
+		// the slot at write - Capacity is the next one its thread
+		// fills, the entries it overwrites during the copy are
+		// dropped afterwards
+		auto write = b->write.load(std::memory_order_acquire);
+		auto first = write >= Capacity ? write - Capacity + 1 : 0;
+		ring.clear();
+		for (auto i = first; i < write; ++i)
+		{
+			const auto &slot = b->events[i % Capacity];
+			ring.push_back({slot.name.load(std::memory_order_relaxed),
+			                slot.start.load(std::memory_order_relaxed),
+			                slot.duration.load(std::memory_order_relaxed)});
+		}
+		// pairs with the fence of the writer: a slot read from a
+		// later entry makes its index visible below
+		std::atomic_thread_fence(std::memory_order_acquire);
+		auto written = b->write.load(std::memory_order_relaxed);
+		auto valid = written >= Capacity ? std::max(first, written - Capacity + 1) : first;
+		for (auto i = valid; i < write; ++i)
+		{
+			const auto &e = ring[i - first];
+			if (e.start >= c.start && e.start < end)
+			{
+				trace.events.push_back({b->id, e});
+			}
+		}
+	}
+	return trace;
+}
+
+static void
+writeTrace(const Trace &trace)
+{
+	std::ofstream out(trace.path);
+	if (!out)
+	{
+		std::cerr << "CpuProfiler: cannot write " << trace.path << "\n";
+		return;
+	}
+
+	// Chrome trace event format, times in microseconds
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	const char *separator = "";
+	for (const auto &t : trace.threads)
+	{
+		out << separator << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+		    << t.id << ",\"args\":{\"name\":\"" << t.name << "\"}}";
+		separator = ",\n";
+	}
+	for (const auto &[thread, e] : trace.events)
+	{
+		out << separator << "{\"ph\":\"X\",\"name\":\"" << e.name
+		    << "\",\"pid\":1,\"tid\":" << thread
+		    << ",\"ts\":" << e.start / 1000.0
+		    << ",\"dur\":" << e.duration / 1000.0 << "}";
+		separator = ",\n";
+	}
+	for (auto mark : trace.frameMarks)
+	{
+		out << separator << "{\"ph\":\"i\",\"s\":\"g\",\"name\":\"frame\",\"pid\":1,\"tid\":0,\"ts\":"
+		    << mark / 1000.0 << "}";
+		separator = ",\n";
+	}
+	out << "\n]}\n";
+}
+}
+
+namespace CpuProfiler
+{
+Zone::Zone(const char *name) noexcept
+	: mName(name)
+	, mStart(now())
+{
+}
+
+Zone::~Zone()
+{
+	auto &b = getThreadBuffer();
+	auto write = b.write.load(std::memory_order_relaxed);
+	auto &slot = b.events[write % Capacity];
+	// the index published before orders the stores into the slot
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.name.store(mName, std::memory_order_relaxed);
+	slot.start.store(mStart, std::memory_order_relaxed);
+	slot.duration.store(now() - mStart, std::memory_order_relaxed);
+	b.write.store(write + 1, std::memory_order_release);
+}
+
+void
+setThreadName(const char *name)
+{
+	auto &b = getThreadBuffer();
+	std::lock_guard lock(registryMutex);
+	b.name = name;
+}
+
+void
+frameMark()
+{
+	if (!capturing.load(std::memory_order_acquire))
+	{
+		return;
+	}
+
+	std::lock_guard lock(captureMutex);
+	auto t = now();
+	if (!current.started)
+	{
+		current.started = true;
+		current.start = t;
+		return;
+	}
+	current.frameMarks.push_back(t);
+	if (current.frameMarks.size() >= current.frames)
+	{
+		// the zones of the thread marking the frames end before
+		// the mark, the others may still be running; the file is
+		// written on another thread to keep the frame short
+		std::thread(writeTrace, collectTrace(current, t)).detach();
+		current = Capture();
+		capturing = false;
+	}
+}
+
+void
+capture(const std::filesystem::path &path, unsigned frames)
+{
+	std::lock_guard lock(captureMutex);
+	if (capturing || frames == 0)
+	{
+		return;
+	}
+	current = Capture();
+	current.path = path;
+	current.frames = frames;
+	capturing = true;
+}
+}
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+// Scoped CPU zones recorded per thread and exported as a Chrome
+// trace (chrome://tracing, Perfetto). The macros compile to nothing
+// unless CPU_PROFILER is set, see the cpu_profiler build option:
+//  - PROFILE_ZONE(name): time the enclosing scope, name must be a
+//    string literal
+//  - PROFILE_THREAD(name): name the calling thread in the trace
+//  - PROFILE_FRAME(): mark the end of a frame, called by a single
+//    thread
+//  - PROFILE_CAPTURE(path, frames): write the zones of the next
+//    frames to path
+
+#ifndef CPU_PROFILER
+#define CPU_PROFILER 0
+#endif
+
+#if CPU_PROFILER
+
+#include <cstdint>
+#include <filesystem>
+
+namespace CpuProfiler
+{
+class Zone
+{
+public:
+	explicit Zone(const char *name) noexcept;
+	~Zone();
+
+	Zone(const Zone &) = delete;
+	Zone &operator=(const Zone &) = delete;
+
+private:
+	const char *mName;
+	std::int64_t mStart;
+};
+
+void setThreadName(const char *name);
+void frameMark();
+void capture(const std::filesystem::path &path, unsigned frames);
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) CpuProfiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) CpuProfiler::setThreadName(name)
+#define PROFILE_FRAME() CpuProfiler::frameMark()
+#define PROFILE_CAPTURE(path, frames) CpuProfiler::capture(path, frames)
+
+#else
+
+#define PROFILE_ZONE(name) do { } while (0)
+#define PROFILE_THREAD(name) do { } while (0)
+#define PROFILE_FRAME() do { } while (0)
+#define PROFILE_CAPTURE(path, frames) do { } while (0)
+
+#endif
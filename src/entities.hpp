@@ -3,7 +3,7 @@
 #include <vector>
 
 #include <glm/glm.hpp>
-#include "texture.hpp"
+#include "textureatlas.hpp"
 
 struct Paddle
 {
@@ -12,7 +12,7 @@ struct Paddle
 	glm::vec2 vel;
 	glm::vec3 color;
 	bool dead;
-	Texture2D texture;
+	TextureRegion texture;
 };
 
 struct Ball
@@ -22,7 +22,7 @@ struct Ball
 	glm::vec2 vel;
 	glm::vec3 color;
 	bool stuck;
-	Texture2D texture;
+	TextureRegion texture;
 };
 
 struct PowerUP
@@ -41,7 +41,7 @@ struct PowerUP
 		Confuse,
 		Chaos,
 	} type;
-	Texture2D texture;
+	TextureRegion texture;
 };
 
 struct Block
@@ -50,11 +50,21 @@ struct Block
 	unsigned type;
 	bool solid;
 	bool dead;
+	// column and row in the grid of the level
+	glm::uvec2 cell;
 };
 
 struct Level
 {
 	std::vector<Block> blocks;
 	glm::vec2 blockSize;
-	Texture2D texture;
+	TextureRegion texture;
+
+	// size of the grid and position of its top-left corner
+	unsigned columns;
+	unsigned rows;
+	glm::vec2 origin;
+
+	// indices of the blocks changed since the level was drawn
+	std::vector<std::size_t> dirty;
 };
@@ -0,0 +1,17 @@
+#pragma once
+
+// Error checking levels of the glCheck() and alCheck() macros:
+//  - off: the calls are not checked at all
+//  - callback: the driver reports the errors asynchronously
+//  - sync: the error state is queried after every call
+#define ERROR_CHECK_OFF 0
+#define ERROR_CHECK_CALLBACK 1
+#define ERROR_CHECK_SYNC 2
+
+#ifndef ERROR_CHECK_LEVEL
+#ifndef NDEBUG
+#define ERROR_CHECK_LEVEL ERROR_CHECK_SYNC
+#else
+#define ERROR_CHECK_LEVEL ERROR_CHECK_CALLBACK
+#endif
+#endif
@@ -42,19 +42,21 @@ EventQueue::poll()
 bool
 EventQueue::empty() const noexcept
 {
-	return mRead == mWrite;
+	return mRead.load(std::memory_order_acquire)
+		== mWrite.load(std::memory_order_acquire);
 }
 
 bool
 EventQueue::pop(Event& event) noexcept
 {
-	if (mRead == mWrite)
+	auto read = mRead.load(std::memory_order_relaxed);
+	if (read == mWrite.load(std::memory_order_acquire))
 	{
 		return false;
 	}
 
-	event = mEvents[mRead & (QUEUE_SIZE-1)];
-	++mRead;
+	event = mEvents[read & (QUEUE_SIZE-1)];
+	mRead.store(read + 1, std::memory_order_release);
 
 	return true;
 }
@@ -62,14 +64,15 @@ EventQueue::pop(Event& event) noexcept
 void
 EventQueue::add(Event&& event)
 {
-	if (mRead + QUEUE_SIZE == mWrite)
+	auto write = mWrite.load(std::memory_order_relaxed);
+	if (mRead.load(std::memory_order_acquire) + QUEUE_SIZE == write)
 	{
 		std::cerr << "EventQueue::add() failed - queue full.\n";
 	}
 	else
 	{
-		mEvents[mWrite & (QUEUE_SIZE-1)] = std::move(event);
-		++mWrite;
+		mEvents[write & (QUEUE_SIZE-1)] = std::move(event);
+		mWrite.store(write + 1, std::memory_order_release);
 	}
 }
 
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <vector>
 
 #include "event.hpp"
 
+// The events are added by the thread polling them and may be
+// popped by another thread.
 class EventQueue
 {
 public:
@@ -31,6 +34,6 @@ private:
 
 	static constexpr std::size_t QUEUE_SIZE = 256;
 	Event mEvents[QUEUE_SIZE];
-	unsigned mRead;
-	unsigned mWrite;
+	std::atomic<unsigned> mRead;
+	std::atomic<unsigned> mWrite;
 };
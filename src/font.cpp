@@ -1,7 +1,13 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 
+#include "cpuprofiler.hpp"
 #include "glcheck.hpp"
 #include "font.hpp"
 #include "utility.hpp"
@@ -12,6 +18,40 @@ const int TEXTURE_WIDTH = 1024;
 const int TEXTURE_HEIGHT = 1024;
 const int PADDING = 2;
 
+// threads rasterizing the prewarmed characters
+const unsigned MAX_WORKERS = 4;
+
+// layout of the atlas cache files, bump the version on changes
+const char CACHE_MAGIC[4] = { 'B', 'K', 'F', 'A' };
+const std::uint32_t CACHE_VERSION = 1;
+
+static std::uint64_t
+hashBytes(const void *data, std::size_t size)
+{
+	// FNV-1a
+	auto bytes = static_cast<const std::uint8_t *>(data);
+	std::uint64_t hash = 14695981039346656037ull;
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+template <typename T>
+static void
+writeValue(std::ostream &out, const T &value)
+{
+	out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool
+readValue(std::istream &in, T &value)
+{
+	return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
 static inline unsigned
 roundUp2(unsigned v)
 {
@@ -26,12 +66,18 @@ roundUp2(unsigned v)
 }
 
 Font::Font()
-	: mFT(nullptr)
+	: mDirectGlyphs()
+	, mDirectLoaded()
+	, mGlyphs()
+	, mFontData()
+	, mSize(0)
+	, mFT(nullptr)
 	, mFace(nullptr)
 	, mLineHeight(0.f)
 	, mPositionX(0)
 	, mPositionY(0)
 	, mMaxHeight(0)
+	, mAtlasVersion(0)
 {
 }
 
@@ -42,33 +88,292 @@ Font::~Font()
 }
 
 bool
-Font::loadFromFile(const std::filesystem::path &path, unsigned size)
+Font::loadFromFile(const std::filesystem::path &path, unsigned size,
+                   std::u32string_view charset, const std::filesystem::path &cacheDir)
 {
+	std::ifstream in(path, std::ios::in | std::ios::binary);
+	if (!in)
+	{
+		std::cerr << "Font::loadFromFile() - Failed to load the font "
+			  << path << std::endl;
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+
+	destroy();
+	mFontData = buffer.str();
+	mSize = size;
+	mDirectLoaded.reset();
+	mGlyphs.clear();
+	mPositionX = mPositionY = mMaxHeight = 0;
+
+	std::filesystem::path cachePath;
+	if (!charset.empty() && !cacheDir.empty())
+	{
+		cachePath = getCachePath(cacheDir);
+		if (loadCache(cachePath, charset))
+		{
+			// FreeType is opened if a character outside the
+			// cached set shows up
+			return true;
+		}
+	}
+
+	if (!openFace())
+	{
+		return false;
+	}
+	if (!charset.empty())
+	{
+		prewarm(charset);
+		if (!cachePath.empty())
+		{
+			saveCache(cachePath, charset);
+		}
+	}
+	return true;
+}
+
+bool
+Font::openFace()
+{
+	FT_Done_Face(mFace);
 	FT_Done_FreeType(mFT);
+	mFace = nullptr;
+	mFT = nullptr;
 	if (FT_Init_FreeType(&mFT))
 	{
-		std::cerr << "Font::loadFromFile() - Cannot initialize the freetype2 library"
+		std::cerr << "Font::openFace() - Cannot initialize the freetype2 library"
 			  << std::endl;
 		return false;
 	}
 
-	FT_Done_Face(mFace);
-	if (FT_New_Face(mFT, path.c_str(), 0, &mFace))
+	auto data = reinterpret_cast<const FT_Byte *>(mFontData.data());
+	if (FT_New_Memory_Face(mFT, data, mFontData.size(), 0, &mFace))
 	{
-		std::cerr << "Font::loadFromFile() - Failed to load the font "
-			  << path << std::endl;
+		std::cerr << "Font::openFace() - Failed to load the font" << std::endl;
 		return false;
 	}
-	FT_Set_Pixel_Sizes(mFace, 0, size);
+	FT_Set_Pixel_Sizes(mFace, 0, mSize);
 
 	mLineHeight = static_cast<float>(mFace->size->metrics.ascender -
 	                                 mFace->size->metrics.descender) / 64.f;
-	mGlyphs.clear();
-	mPositionX = mPositionY = mMaxHeight = 0;
+	return true;
+}
+
+bool
+Font::rasterize(FT_Face face, char32_t codepoint, Bitmap &bitmap)
+{
+	if (FT_Load_Char(face, codepoint, FT_LOAD_RENDER))
+	{
+		return false;
+	}
+
+	const auto &bm = face->glyph->bitmap;
+	bitmap.width = bm.width;
+	bitmap.rows = bm.rows;
+	bitmap.alpha.resize(bm.width * bm.rows);
+	for (unsigned y = 0; y < bm.rows; ++y)
+	{
+		std::copy_n(bm.buffer + y * bm.pitch, bm.width,
+		            bitmap.alpha.begin() + y * bm.width);
+	}
+	bitmap.bearing = glm::vec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
+	bitmap.advance = static_cast<float>(face->glyph->advance.x) / 64.f;
+	return true;
+}
+
+void
+Font::prewarm(std::u32string_view charset)
+{
+	PROFILE_ZONE("Font::prewarm");
+	// a face cannot be used by several threads: each worker opens
+	// its own on the font data and renders a share of the set
+	auto workers = std::clamp(std::thread::hardware_concurrency(), 1u, MAX_WORKERS);
+	std::vector<Bitmap> bitmaps(charset.size());
+	std::vector<std::uint8_t> rendered(charset.size(), 0);
+	std::vector<std::thread> threads;
+	for (unsigned w = 0; w < workers; ++w)
+	{
+		threads.emplace_back([&, w] {
+			FT_Library library;
+			if (FT_Init_FreeType(&library))
+			{
+				return;
+			}
+			FT_Face face;
+			auto data = reinterpret_cast<const FT_Byte *>(mFontData.data());
+			if (!FT_New_Memory_Face(library, data, mFontData.size(), 0, &face))
+			{
+				FT_Set_Pixel_Sizes(face, 0, mSize);
+				for (auto i = w; i < charset.size(); i += workers)
+				{
+					rendered[i] = rasterize(face, charset[i], bitmaps[i]);
+				}
+				FT_Done_Face(face);
+			}
+			FT_Done_FreeType(library);
+		});
+	}
+	for (auto &t : threads)
+	{
+		t.join();
+	}
+
+	// the texture is filled on the thread owning the context; the
+	// characters the workers could not render are loaded lazily
+	for (std::size_t i = 0; i < charset.size(); ++i)
+	{
+		if (rendered[i] && !hasGlyph(charset[i]))
+		{
+			storeGlyph(charset[i], addGlyph(bitmaps[i]));
+		}
+	}
+}
+
+std::filesystem::path
+Font::getCachePath(const std::filesystem::path &cacheDir) const
+{
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0')
+	     << hashBytes(mFontData.data(), mFontData.size())
+	     << std::dec << '-' << mSize << ".atlas";
+	return cacheDir / name.str();
+}
+
+bool
+Font::loadCache(const std::filesystem::path &path, std::u32string_view charset)
+{
+	PROFILE_ZONE("Font::loadCache");
+	std::ifstream in(path, std::ios::in | std::ios::binary);
+	if (!in)
+	{
+		return false;
+	}
+
+	// a cache of another version or for another set is rebuilt
+	char magic[4];
+	std::uint32_t version;
+	std::uint64_t charsetHash;
+	float lineHeight;
+	int positionX, positionY, maxHeight;
+	std::uint32_t texWidth, texHeight, count;
+	if (!in.read(magic, sizeof(magic))
+	    || !std::equal(magic, magic + 4, CACHE_MAGIC)
+	    || !readValue(in, version) || version != CACHE_VERSION
+	    || !readValue(in, charsetHash)
+	    || charsetHash != hashBytes(charset.data(), charset.size() * sizeof(char32_t))
+	    || !readValue(in, lineHeight)
+	    || !readValue(in, positionX)
+	    || !readValue(in, positionY)
+	    || !readValue(in, maxHeight)
+	    || !readValue(in, texWidth)
+	    || !readValue(in, texHeight)
+	    || !readValue(in, count)
+	    || texWidth > TEXTURE_WIDTH || texHeight > TEXTURE_HEIGHT)
+	{
+		return false;
+	}
 
+	// the cache holds the set and the glyphs loaded before it was
+	// saved, a larger count is a corrupt file
+	if (count > charset.size() + mGlyphs.size() + mDirectLoaded.count())
+	{
+		return false;
+	}
+
+	std::vector<std::pair<char32_t, Glyph>> glyphs(count);
+	for (auto &[codepoint, glyph] : glyphs)
+	{
+		if (!readValue(in, codepoint) || !readValue(in, glyph))
+		{
+			return false;
+		}
+	}
+	std::vector<std::uint8_t> alpha(texWidth * texHeight);
+	if (!in.read(reinterpret_cast<char *>(alpha.data()), alpha.size()))
+	{
+		return false;
+	}
+
+	mPixelBuffer.resize(alpha.size() * 4);
+	for (std::size_t i = 0; i < alpha.size(); ++i)
+	{
+		mPixelBuffer[i * 4 + 0] = 255;
+		mPixelBuffer[i * 4 + 1] = 255;
+		mPixelBuffer[i * 4 + 2] = 255;
+		mPixelBuffer[i * 4 + 3] = alpha[i];
+	}
+	if (texWidth && texHeight && !mTexture.create(texWidth, texHeight, mPixelBuffer.data()))
+	{
+		return false;
+	}
+	for (const auto &[codepoint, glyph] : glyphs)
+	{
+		storeGlyph(codepoint, glyph);
+	}
+	mLineHeight = lineHeight;
+	mPositionX = positionX;
+	mPositionY = positionY;
+	mMaxHeight = maxHeight;
+	mAtlasVersion++;
 	return true;
 }
 
+void
+Font::saveCache(const std::filesystem::path &path, std::u32string_view charset) const
+{
+	PROFILE_ZONE("Font::saveCache");
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	std::uint32_t texWidth = mTexture.getWidth();
+	std::uint32_t texHeight = mTexture.getHeight();
+	std::vector<std::uint8_t> pixels(texWidth * texHeight * 4);
+	if (texWidth && texHeight)
+	{
+		mTexture.download(pixels.data());
+	}
+
+	std::vector<std::pair<char32_t, Glyph>> glyphs;
+	for (char32_t c = 0; c < DirectGlyphs; ++c)
+	{
+		if (mDirectLoaded[c])
+		{
+			glyphs.emplace_back(c, mDirectGlyphs[c]);
+		}
+	}
+	glyphs.insert(glyphs.end(), mGlyphs.begin(), mGlyphs.end());
+
+	std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	writeValue(out, CACHE_VERSION);
+	writeValue(out, hashBytes(charset.data(), charset.size() * sizeof(char32_t)));
+	writeValue(out, mLineHeight);
+	writeValue(out, mPositionX);
+	writeValue(out, mPositionY);
+	writeValue(out, mMaxHeight);
+	writeValue(out, texWidth);
+	writeValue(out, texHeight);
+	writeValue(out, static_cast<std::uint32_t>(glyphs.size()));
+	for (const auto &[codepoint, glyph] : glyphs)
+	{
+		writeValue(out, codepoint);
+		writeValue(out, glyph);
+	}
+	for (std::size_t i = 0; i < pixels.size(); i += 4)
+	{
+		out.put(static_cast<char>(pixels[i + 3]));
+	}
+	if (!out)
+	{
+		std::cerr << "Font::saveCache() - failed to write " << path << std::endl;
+		out.close();
+		std::filesystem::remove(path, error);
+	}
+}
+
 void
 Font::destroy()
 {
@@ -77,15 +382,22 @@ Font::destroy()
 	mFace = nullptr;
 	mFT = nullptr;
 	mTexture.destroy();
+	mFontData.clear();
+	mAtlasVersion++;
 }
 
 glm::vec2
 Font::getSize(const std::string &text)
+{
+	return getSize(Utility::decodeUTF8(text));
+}
+
+glm::vec2
+Font::getSize(std::u32string_view text)
 {
 	float width = 0;
 	float height = 0;
-	auto codepoints = Utility::decodeUTF8(text);
-	for (auto codepoint: codepoints)
+	for (auto codepoint: text)
 	{
 		const auto &glyph = getGlyph(codepoint);
 		if (height < glyph.size.y + glyph.bearing.y)
@@ -112,30 +424,102 @@ Font::resizeTexture(unsigned newWidth, unsigned newHeight)
 		static_cast<float>(oldWidth) / newWidth,
 		static_cast<float>(oldHeight) / newHeight
 	};
+	for (auto &glyph: mDirectGlyphs)
+	{
+		glyph.uvPos *= scale;
+		glyph.uvSize *= scale;
+	}
 	for (auto &[codepoint, glyph]: mGlyphs)
 	{
 		glyph.uvPos *= scale;
 		glyph.uvSize *= scale;
 	}
+	mAtlasVersion++;
+}
+
+unsigned
+Font::getAtlasVersion() const
+{
+	return mAtlasVersion;
+}
+
+float
+Font::getOccupancy() const
+{
+	return static_cast<float>(mPositionY + mMaxHeight) / TEXTURE_HEIGHT;
 }
 
 const Glyph&
 Font::getGlyph(char32_t codepoint)
 {
+	if (codepoint < DirectGlyphs)
+	{
+		if (!mDirectLoaded[codepoint])
+		{
+			storeGlyph(codepoint, loadGlyph(codepoint));
+		}
+		return mDirectGlyphs[codepoint];
+	}
+
 	if (const auto it = mGlyphs.find(codepoint); it != mGlyphs.end())
 	{
 		return it->second;
 	}
+	return storeGlyph(codepoint, loadGlyph(codepoint));
+}
 
-	if (FT_Load_Char(mFace, codepoint, FT_LOAD_RENDER))
+bool
+Font::hasGlyph(char32_t codepoint) const
+{
+	return codepoint < DirectGlyphs
+		? mDirectLoaded[codepoint]
+		: mGlyphs.contains(codepoint);
+}
+
+const Glyph &
+Font::storeGlyph(char32_t codepoint, const Glyph &glyph)
+{
+	if (codepoint < DirectGlyphs)
+	{
+		mDirectGlyphs[codepoint] = glyph;
+		mDirectLoaded[codepoint] = true;
+		return mDirectGlyphs[codepoint];
+	}
+
+	const auto [it, success] = mGlyphs.insert(std::make_pair(codepoint, glyph));
+	if (!success)
+	{
+		throw std::runtime_error("Font::storeGlyph() - "
+					 "can't add the glyph to the map");
+	}
+	return it->second;
+}
+
+Glyph
+Font::loadGlyph(char32_t codepoint)
+{
+	PROFILE_ZONE("Font::loadGlyph");
+	// the face is not opened when the atlas came from the cache
+	if (!mFace && !openFace())
+	{
+		throw std::runtime_error("Font::loadGlyph() - cannot open the face");
+	}
+
+	Bitmap bitmap;
+	if (!rasterize(mFace, codepoint, bitmap))
 	{
 		throw std::runtime_error(
-			"Font::getGlyph() - cannot load the glyph for codepoint "
+			"Font::loadGlyph() - cannot load the glyph for codepoint "
 			+ std::to_string(codepoint));
 	}
+	return addGlyph(bitmap);
+}
 
-	int bmWidth = mFace->glyph->bitmap.width + 2 * PADDING;
-	int bmHeight = mFace->glyph->bitmap.rows + 2 * PADDING;
+Glyph
+Font::addGlyph(const Bitmap &bitmap)
+{
+	int bmWidth = bitmap.width + 2 * PADDING;
+	int bmHeight = bitmap.rows + 2 * PADDING;
 	if (mMaxHeight < bmHeight)
 	{
 		mMaxHeight = bmHeight;
@@ -146,9 +530,9 @@ Font::getGlyph(char32_t codepoint)
 	bool resize = false;
 	if (unsigned right = mPositionX + bmWidth; right > texWidth)
 	{
-		unsigned newTexWidth = texWidth
-			? texWidth * 2
-			: roundUp2(right);
+		// a large glyph after small ones can need more than
+		// twice the width
+		unsigned newTexWidth = std::max(texWidth * 2, roundUp2(right));
 		if (newTexWidth <= TEXTURE_WIDTH)
 		{
 			texWidth = newTexWidth;
@@ -163,9 +547,7 @@ Font::getGlyph(char32_t codepoint)
 	}
 	if (unsigned bottom = mPositionY + bmHeight; bottom > texHeight)
 	{
-		unsigned newTexHeight = texHeight
-			? texHeight * 2
-			: roundUp2(bottom);
+		unsigned newTexHeight = std::max(texHeight * 2, roundUp2(bottom));
 		if (newTexHeight <= TEXTURE_HEIGHT)
 		{
 			texHeight = newTexHeight;
@@ -173,7 +555,7 @@ Font::getGlyph(char32_t codepoint)
 		}
 		else
 		{
-			throw std::runtime_error("Font::getGlyph() - "
+			throw std::runtime_error("Font::loadGlyph() - "
 						 "no space left in the texture");
 		}
 	}
@@ -194,15 +576,15 @@ Font::getGlyph(char32_t codepoint)
 	}
 
 	// render the glyph
-	pix = mFace->glyph->bitmap.buffer;
+	const std::uint8_t *coverage = bitmap.alpha.data();
 	for (int y = PADDING; y < bmHeight - PADDING; ++y)
 	{
 		for (int x = PADDING; x < bmWidth - PADDING; ++x)
 		{
 			const std::size_t index = x + y * bmWidth;
-			mPixelBuffer[index * 4 + 3] = pix[x - PADDING];
+			mPixelBuffer[index * 4 + 3] = coverage[x - PADDING];
 		}
-		pix += mFace->glyph->bitmap.pitch;
+		coverage += bitmap.width;
 	}
 
 	// upload the data
@@ -218,20 +600,12 @@ Font::getGlyph(char32_t codepoint)
 	glyph.uvSize.y = static_cast<float>(bmHeight) / texHeight;
 
 	glyph.size = glm::vec2(bmWidth, bmHeight);
-	glyph.bearing = glm::vec2(mFace->glyph->bitmap_left,
-				  mFace->glyph->bitmap_top);
-	glyph.advance = static_cast<float>(mFace->glyph->advance.x) / 64.f;
-
-	const auto [it, success] = mGlyphs.insert(std::make_pair(codepoint, std::move(glyph)));
-	if (!success)
-	{
-		throw std::runtime_error("Font::getGlyph() - "
-					 "can't add the glyph to the map");
-	}
+	glyph.bearing = bitmap.bearing;
+	glyph.advance = bitmap.advance;
 
 	mPositionX += bmWidth + 2 * PADDING;
 
-	return it->second;
+	return glyph;
 }
 
 const Texture2D &
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <array>
+#include <bitset>
+#include <cstdint>
 #include <filesystem>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -22,6 +27,11 @@ struct Glyph
 
 class Font
 {
+public:
+	// the glyphs of the lower codepoints live in a flat table, the
+	// others in a hash map
+	static constexpr char32_t DirectGlyphs = 256;
+
 public:
 	Font();
 	~Font();
@@ -31,26 +41,65 @@ public:
 	Font(Font&&) noexcept = delete;
 	Font& operator=(Font&&) noexcept = delete;
 
-	bool loadFromFile(const std::filesystem::path &path, unsigned size);
+	// The characters of charset are rasterized at load time on
+	// worker threads. With a cache directory the finished atlas is
+	// saved there, keyed by the hash of the font file and the size,
+	// and the later loads read it back without FreeType.
+	bool loadFromFile(const std::filesystem::path &path, unsigned size,
+	                  std::u32string_view charset = {},
+	                  const std::filesystem::path &cacheDir = {});
 	void destroy();
 
 	glm::vec2 getSize(const std::string &text);
+	glm::vec2 getSize(std::u32string_view text);
 
 	const Glyph& getGlyph(char32_t codepoint);
 	const Texture2D& getTexture() const;
 	float getLineHeight() const;
+	// fraction of the largest texture filled by the glyphs
+	float getOccupancy() const;
+	// changes when the texture coordinates of the glyphs move
+	unsigned getAtlasVersion() const;
 
 private:
+	// coverage of a rendered glyph, one byte per pixel
+	struct Bitmap
+	{
+		unsigned width;
+		unsigned rows;
+		std::vector<std::uint8_t> alpha;
+		glm::vec2 bearing;
+		float advance;
+	};
+
+	bool openFace();
+	static bool rasterize(FT_Face face, char32_t codepoint, Bitmap &bitmap);
+	void prewarm(std::u32string_view charset);
+	std::filesystem::path getCachePath(const std::filesystem::path &cacheDir) const;
+	bool loadCache(const std::filesystem::path &path, std::u32string_view charset);
+	void saveCache(const std::filesystem::path &path, std::u32string_view charset) const;
+
 	void resizeTexture(unsigned newWidth, unsigned newHeight);
+	// rasterize the glyph and add it to the texture
+	Glyph loadGlyph(char32_t codepoint);
+	Glyph addGlyph(const Bitmap &bitmap);
+	bool hasGlyph(char32_t codepoint) const;
+	const Glyph &storeGlyph(char32_t codepoint, const Glyph &glyph);
 
+	std::array<Glyph, DirectGlyphs> mDirectGlyphs;
+	std::bitset<DirectGlyphs> mDirectLoaded;
 	std::unordered_map<char32_t, Glyph> mGlyphs;
 	std::vector<std::uint8_t> mPixelBuffer;
 	Texture2D mTexture;
 
+	// the faces are opened from memory, by the workers too
+	std::string mFontData;
+	unsigned mSize;
 	FT_Library mFT;
 	FT_Face mFace;
 	float mLineHeight;
 	int mPositionX;
 	int mPositionY;
 	int mMaxHeight;
+	unsigned mAtlasVersion;
 };
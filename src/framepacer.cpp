@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+#include "framepacer.hpp"
+
+namespace
+{
+// initial and minimum time spent spinning before the deadline
+static constexpr auto MinSpinMargin = std::chrono::microseconds(500);
+static constexpr auto MaxSpinMargin = std::chrono::milliseconds(4);
+}
+
+FramePacer::FramePacer()
+	: mVSync(VSync::On)
+	, mTargetFPS(0.0)
+	, mPeriod(Clock::duration::zero())
+	, mSpinMargin(MinSpinMargin)
+	, mDeadline(Clock::now())
+	, mLastFrame(mDeadline)
+	, mFrameTimes()
+	, mFrameCount(0)
+{
+}
+
+void
+FramePacer::setVSync(VSync mode)
+{
+	int interval = 0;
+	switch (mode)
+	{
+	case VSync::Off:
+		interval = 0;
+		break;
+	case VSync::On:
+		interval = 1;
+		break;
+	case VSync::Adaptive:
+		// late frames are swapped immediately instead of
+		// waiting for the next vertical blank
+		if (glfwExtensionSupported("WGL_EXT_swap_control_tear")
+		    || glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+		{
+			interval = -1;
+		}
+		else
+		{
+			interval = 1;
+			mode = VSync::On;
+		}
+		break;
+	}
+	glfwSwapInterval(interval);
+	mVSync = mode;
+}
+
+FramePacer::VSync
+FramePacer::getVSync() const
+{
+	return mVSync;
+}
+
+void
+FramePacer::setTargetFPS(double fps)
+{
+	if (fps == mTargetFPS)
+	{
+		return;
+	}
+	mTargetFPS = fps;
+	mPeriod = fps > 0.0
+		? std::chrono::duration_cast<Clock::duration>(
+			std::chrono::duration<double>(1.0 / fps))
+		: Clock::duration::zero();
+	mDeadline = Clock::now() + mPeriod;
+}
+
+double
+FramePacer::getTargetFPS() const
+{
+	return mTargetFPS;
+}
+
+void
+FramePacer::waitUntil(Clock::time_point deadline)
+{
+	// sleep for the bulk of the wait, the scheduler may wake
+	// us up late: the margin follows the observed oversleep
+	auto wakeup = deadline - mSpinMargin;
+	if (Clock::now() < wakeup)
+	{
+		std::this_thread::sleep_until(wakeup);
+		auto late = Clock::now() - wakeup;
+		mSpinMargin = std::clamp<Clock::duration>(
+			(mSpinMargin * 7 + late * 2) / 8,
+			MinSpinMargin, MaxSpinMargin);
+	}
+
+	// spin for the last stretch
+	while (Clock::now() < deadline)
+	{
+		std::this_thread::yield();
+	}
+}
+
+void
+FramePacer::endFrame()
+{
+	if (mPeriod > Clock::duration::zero())
+	{
+		waitUntil(mDeadline);
+
+		// don't try to catch up when we are more than a
+		// frame late, that would only produce a burst
+		mDeadline += mPeriod;
+		auto now = Clock::now();
+		if (mDeadline < now)
+		{
+			mDeadline = now + mPeriod;
+		}
+	}
+
+	auto now = Clock::now();
+	std::chrono::duration<double> frameTime = now - mLastFrame;
+	mLastFrame = now;
+	mFrameTimes[mFrameCount++ % History] = frameTime.count();
+}
+
+double
+FramePacer::getFrameTime() const
+{
+	return mFrameCount > 0 ? mFrameTimes[(mFrameCount - 1) % History] : 0.0;
+}
+
+std::size_t
+FramePacer::getFrameCount() const
+{
+	return std::min(mFrameCount, History);
+}
+
+double
+FramePacer::getFrameTime(std::size_t index) const
+{
+	return mFrameTimes[(mFrameCount - getFrameCount() + index) % History];
+}
+
+FramePacer::Stats
+FramePacer::getStats() const
+{
+	Stats stats{};
+	auto count = std::min(mFrameCount, History);
+	if (count == 0)
+	{
+		return stats;
+	}
+
+	stats.minimum = mFrameTimes[0];
+	stats.maximum = mFrameTimes[0];
+	double sum = 0.0;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		sum += mFrameTimes[i];
+		stats.minimum = std::min(stats.minimum, mFrameTimes[i]);
+		stats.maximum = std::max(stats.maximum, mFrameTimes[i]);
+	}
+	stats.average = sum / count;
+
+	double variance = 0.0;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		double d = mFrameTimes[i] - stats.average;
+		variance += d * d;
+	}
+	stats.deviation = std::sqrt(variance / count);
+	return stats;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+
+// Controls the frame rate: selects the swap interval and, when a
+// target rate is set, sleeps until shortly before the deadline of
+// the frame and spins for the last stretch.
+class FramePacer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	enum class VSync
+	{
+		Off,
+		On,
+		Adaptive,
+	};
+
+	// frame time statistics in seconds
+	struct Stats
+	{
+		double average;
+		double deviation;
+		double minimum;
+		double maximum;
+	};
+
+public:
+	FramePacer();
+
+	// requires a current OpenGL context
+	void setVSync(VSync mode);
+	VSync getVSync() const;
+
+	// 0 disables the limiter
+	void setTargetFPS(double fps);
+	double getTargetFPS() const;
+
+	// wait for the deadline of the frame and record its duration
+	void endFrame();
+
+	Stats getStats() const;
+	// duration of the last frame in seconds
+	double getFrameTime() const;
+	// number of recorded frames, at most History, and the duration
+	// of each in seconds from the oldest
+	std::size_t getFrameCount() const;
+	double getFrameTime(std::size_t index) const;
+
+	static constexpr std::size_t History = 120;
+
+private:
+	void waitUntil(Clock::time_point deadline);
+
+	VSync mVSync;
+	double mTargetFPS;
+	Clock::duration mPeriod;
+	Clock::duration mSpinMargin;
+	Clock::time_point mDeadline;
+	Clock::time_point mLastFrame;
+
+	std::array<double, History> mFrameTimes;
+	std::size_t mFrameCount;
+};
@@ -1,14 +1,20 @@
 #include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
+#include "cpuprofiler.hpp"
 #include "font.hpp"
 #include "game.hpp"
 #include "glcheck.hpp"
+#include "glstate.hpp"
+#include "gpuprofiler.hpp"
 #include "particle.hpp"
 #include "postprocess.hpp"
 #include "renderer.hpp"
+#include "utility.hpp"
 
 namespace
 {
@@ -29,37 +35,84 @@ static constexpr std::string_view levels[] = {
 
 const unsigned ScreenWidth = 800;
 const unsigned ScreenHeight = 600;
+
+// frame rate cap of the static screens
+static constexpr double MenuFPS = 30.0;
+
+// length of the CPU profiler captures
+[[maybe_unused]] static constexpr unsigned TraceFrames = 120;
+
+// fixed rate of the simulation, independent of the display
+static constexpr auto TickTime = std::chrono::microseconds(1000000 / 120);
+
+// characters rendered when the fonts are loaded, printable ASCII,
+// and where their atlases are saved for the next launches
+static constexpr std::u32string_view FontCharset =
+	U" !\"#$%&'()*+,-./0123456789:;<=>?"
+	U"@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_"
+	U"`abcdefghijklmnopqrstuvwxyz{|}~";
+static constexpr std::string_view FontCacheDir = "cache/fonts";
+
+static Postprocess::Antialiasing
+nextAntialiasing(Postprocess::Antialiasing mode)
+{
+	switch (mode)
+	{
+	case Postprocess::Antialiasing::None: return Postprocess::Antialiasing::MSAA2;
+	case Postprocess::Antialiasing::MSAA2: return Postprocess::Antialiasing::MSAA4;
+	case Postprocess::Antialiasing::MSAA4: return Postprocess::Antialiasing::MSAA8;
+	case Postprocess::Antialiasing::MSAA8: return Postprocess::Antialiasing::FXAA;
+	case Postprocess::Antialiasing::FXAA: return Postprocess::Antialiasing::None;
+	}
+	return mode;
+}
 }
 
-Game::Game()
+Game::Game(const GameOptions &options)
 	: mState(State::Menu)
 	, mCurrentLevel(0)
 	, mLives(InitialLives)
+	, mChaos(false)
+	, mConfuse(false)
+	, mShake(false)
+	, mMoveLeft(false)
+	, mMoveRight(false)
+	, mLaunch(false)
+	, mVSync(FramePacer::VSync::Adaptive)
+	, mAntialiasing(options.antialiasing)
+	, mShowProfiler(false)
+	, mShowHud(false)
+	, mTickTime(0.0)
+	, mQuit(false)
+	, mPendingChanges()
+	, mChangeSequence(0)
+	, mRunning(false)
+	, mAppliedChanges(0)
+	, mSceneVSync(mVSync)
+	, mSceneAntialiasing(options.antialiasing)
+	, mRefreshRate(60.0)
+	, mHudTime(0.0)
+	, mOptions(options)
 	, mWindow(nullptr)
+	, mHeadlessFrame(0)
+	, mOffscreenFBO(0)
 {
-	const char *error;
-	if (!glfwInit())
+	if (mOptions.headless)
 	{
-		glfwGetError(&error);
-		throw std::runtime_error(error);
+		// no window system at all, the context renders into the
+		// offscreen target
+		mHeadlessContext.create();
 	}
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-
-	mWindow = glfwCreateWindow(
-		ScreenWidth, ScreenHeight, "Breakout",
-		nullptr, nullptr);
-	if (!mWindow)
+	else
 	{
-		glfwGetError(&error);
-		throw std::runtime_error(error);
+		createWindow();
 	}
-	glfwMakeContextCurrent(mWindow);
 	glewExperimental = GL_TRUE;
 
-	if (GLEW_OK != glewInit())
+	// GLEW looks for the GLX extensions after the GL entry points and
+	// fails without a GLX display, the EGL context only needs the GL ones
+	GLenum status = mOptions.headless ? glewContextInit() : glewInit();
+	if (GLEW_OK != status)
 	{
 		throw std::runtime_error("Unable to initialize GLEW");
 	}
@@ -68,40 +121,70 @@ Game::Game()
 	{
 		throw std::runtime_error("ARB_texture_storage required!");
 	}
+	glInitDebugOutput();
+	if (mOptions.headless)
+	{
+		createOffscreenTarget();
+	}
+	else
+	{
+		mPacer.setVSync(mSceneVSync);
+	}
 
-	glCheck(glViewport(0, 0, ScreenWidth, ScreenHeight));
+	// the framebuffer is larger than the window on high density
+	// screens, the offscreen target has the size of the screen
+	int framebufferWidth = ScreenWidth;
+	int framebufferHeight = ScreenHeight;
+	if (!mOptions.headless)
+	{
+		glfwGetFramebufferSize(mWindow, &framebufferWidth, &framebufferHeight);
+	}
+
+	glCheck(glViewport(0, 0, framebufferWidth, framebufferHeight));
 	glCheck(glEnable(GL_CULL_FACE));
 	glCheck(glEnable(GL_BLEND));
-	glCheck(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+	GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// audio device
-	if (!mAudioDevice.open(""))
+	// audio device, the headless runs can do without
+	if (!mAudioDevice.open("") && !mOptions.headless)
 	{
 		throw std::runtime_error("Cannot open the audio device");
 	}
 	mAudioDevice.setMasterVolume(50.f);
 
-	mEventQueue.track(mWindow);
+	if (mWindow)
+	{
+		mEventQueue.track(mWindow);
+	}
 
 	// load the assets
 	loadAssets();
 
 	// make the batch renderer
-	mRenderer = std::make_unique<Renderer>(ScreenWidth, ScreenHeight, mShaders);
+	mRenderer = std::make_unique<Renderer>(ScreenWidth, ScreenHeight,
+	                                       framebufferWidth, framebufferHeight,
+	                                       mShaders, mPostShaders, mBlurShaders);
 
 	// set-up the effects
 	mEffects = std::make_unique<Postprocess>(
-		ScreenWidth,
-		ScreenHeight);
+		framebufferWidth,
+		framebufferHeight,
+		mSceneAntialiasing);
+	if (mOptions.renderScale > 0.f)
+	{
+		mEffects->setRenderScale(mOptions.renderScale);
+	}
+
+	mGpuProfiler = std::make_unique<GpuProfiler>();
 
 	// ball particles
 	mBallParticles = std::make_unique<ParticleGen>(
-		mTextures.get(TextureID::Particle),
+		mAtlas.get(TextureID::Particle),
 		500);
 
 	// setup the world data
 	// levels
-	auto &blocksTex = mTextures.get(TextureID::Blocks);
+	auto &blocksTex = mAtlas.get(TextureID::Blocks);
 	for (auto path : levels)
 	{
 		Level level;
@@ -113,47 +196,314 @@ Game::Game()
 		level.texture = blocksTex;
 		mLevels.push_back(std::move(level));
 	}
+	mSceneLevels = mLevels;
 
 	// player and ball
-	mPlayer.texture = mTextures.get(TextureID::Paddle);
+	mPlayer.texture = mAtlas.get(TextureID::Paddle);
 	mBall.size = glm::vec2(BallRadius * 2.f);
-	mBall.texture = mTextures.get(TextureID::Face);
+	mBall.texture = mAtlas.get(TextureID::Face);
 	resetPlayer();
 }
 
 Game::~Game()
 {
+	if (mOffscreenFBO)
+	{
+		GLState::deleteFramebuffer(mOffscreenFBO);
+		mOffscreenTexture.destroy();
+	}
 	mTextures.destroy();
+	mAtlas.destroy();
 	mShaders.destroy();
+	mPostShaders.destroy();
+	mBlurShaders.destroy();
 	mFonts.destroy();
-	glfwDestroyWindow(mWindow);
-	glfwTerminate();
+	mGpuProfiler.reset();
+	mEffects.reset();
+	mRenderer.reset();
+	if (mWindow)
+	{
+		glfwDestroyWindow(mWindow);
+		glfwTerminate();
+	}
 }
 
 void
 Game::run()
 {
-	// variable-time game loop
-	auto currentTime = glfwGetTime();
+	if (mOptions.headless)
+	{
+		runHeadless();
+		return;
+	}
+
+	// the simulation runs on its own thread, this one polls the
+	// events and draws the newest snapshot of the world
+	publish();
+	mRunning = true;
+	std::thread simulation(&Game::simulate, this);
+	PROFILE_THREAD("render");
+
 	while (!glfwWindowShouldClose(mWindow))
 	{
-		auto newTime = glfwGetTime();
-		auto frameTime = newTime - currentTime;
-		currentTime = newTime;
+		mEventQueue.poll();
+		acquire();
+
+		render();
+		{
+			PROFILE_ZONE("glfwSwapBuffers");
+			glfwSwapBuffers(mWindow);
+		}
+
+		updatePacing();
+		mPacer.endFrame();
+		PROFILE_FRAME();
+	}
+
+	mRunning = false;
+	simulation.join();
+}
 
+void
+Game::runHeadless()
+{
+	// one tick per frame on this thread: the frames are the same
+	// from a run to the next
+	mState = State::Active;
+	mLaunch = true;
+	publish();
+	if (!mOptions.dumpPath.empty())
+	{
+		std::filesystem::create_directories(mOptions.dumpPath);
+	}
+
+	typedef std::chrono::steady_clock Clock;
+	std::chrono::duration<double, std::milli> total(0), slowest(0);
+	for (unsigned frame = 0; frame < mOptions.frames; ++frame)
+	{
+		mHeadlessFrame = frame;
 		processInput();
-		update(frameTime);
-		mAudioDevice.update();
+		update(std::chrono::duration<float>(TickTime).count());
+		publish();
+		acquire();
 
+		// wait for the GPU to time the whole frame
+		auto start = Clock::now();
 		render();
-		glfwSwapBuffers(mWindow);
+		glCheck(glFinish());
+		std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+		total += elapsed;
+		slowest = std::max(slowest, elapsed);
+
+		if (!mOptions.dumpPath.empty())
+		{
+			dumpFrame(frame);
+		}
+		PROFILE_FRAME();
+	}
+
+	if (mOptions.frames > 0)
+	{
+		std::cout << mOptions.frames << " frames, "
+		          << total.count() / mOptions.frames << " ms average, "
+		          << slowest.count() << " ms slowest\n";
+	}
+}
+
+void
+Game::createWindow()
+{
+	const char *error;
+	if (!glfwInit())
+	{
+		glfwGetError(&error);
+		throw std::runtime_error(error);
+	}
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+#if ERROR_CHECK_LEVEL == ERROR_CHECK_CALLBACK
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#elif ERROR_CHECK_LEVEL == ERROR_CHECK_OFF
+	glfwWindowHint(GLFW_CONTEXT_NO_ERROR, GLFW_TRUE);
+#endif
+
+	mWindow = glfwCreateWindow(
+		ScreenWidth, ScreenHeight, "Breakout",
+		nullptr, nullptr);
+	if (!mWindow)
+	{
+		glfwGetError(&error);
+		throw std::runtime_error(error);
+	}
+	glfwMakeContextCurrent(mWindow);
+
+	// the pacing reads it every frame
+	auto monitor = glfwGetPrimaryMonitor();
+	auto mode = monitor ? glfwGetVideoMode(monitor) : nullptr;
+	if (mode && mode->refreshRate > 0)
+	{
+		mRefreshRate = mode->refreshRate;
+	}
+}
+
+void
+Game::createOffscreenTarget()
+{
+	glCheck(glGenFramebuffers(1, &mOffscreenFBO));
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, mOffscreenFBO);
+	mOffscreenTexture.create(ScreenWidth, ScreenHeight);
+	mOffscreenTexture.attachToFramebuffer(0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		throw std::runtime_error("Game: Failed to initialize the offscreen FBO");
+	}
+	GLState::setDefaultFramebuffer(mOffscreenFBO);
+}
+
+void
+Game::dumpFrame(unsigned frame)
+{
+	std::vector<std::uint8_t> pixels(ScreenWidth * ScreenHeight * 4);
+	GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, mOffscreenFBO);
+	glCheck(glReadPixels(0, 0, ScreenWidth, ScreenHeight,
+	                     GL_RGBA, GL_UNSIGNED_BYTE, pixels.data()));
+
+	// OpenGL rows go from bottom to top
+	auto stride = ScreenWidth * 4;
+	for (unsigned y = 0; y < ScreenHeight / 2; ++y)
+	{
+		std::swap_ranges(pixels.begin() + y * stride,
+		                 pixels.begin() + (y + 1) * stride,
+		                 pixels.begin() + (ScreenHeight - 1 - y) * stride);
+	}
+
+	std::ostringstream name;
+	name << "frame" << std::setw(5) << std::setfill('0') << frame << ".png";
+	auto path = mOptions.dumpPath / name.str();
+	if (!Utility::savePNG(path, ScreenWidth, ScreenHeight, pixels.data()))
+	{
+		std::cerr << "Game::dumpFrame() - failed to write " << path << "\n";
+	}
+}
+
+void
+Game::simulate()
+{
+	// fixed-time loop, late ticks are caught up without waiting
+	// but never more than a few of them
+	PROFILE_THREAD("simulation");
+	typedef std::chrono::steady_clock Clock;
+	auto next = Clock::now();
+	while (mRunning)
+	{
+		auto start = Clock::now();
+		processInput();
+		update(std::chrono::duration<float>(TickTime).count());
+		mAudioDevice.update();
+		mTickTime = std::chrono::duration<double>(Clock::now() - start).count();
+		publish();
+
+		next += TickTime;
+		auto now = Clock::now();
+		if (next + TickTime * 4 < now)
+		{
+			next = now;
+		}
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void
+Game::publish()
+{
+	auto &snapshot = mSnapshots.getBack();
+	snapshot.state = mState;
+	snapshot.level = mCurrentLevel;
+	snapshot.lives = mLives;
+	snapshot.player = mPlayer;
+	snapshot.ball = mBall;
+	snapshot.powerUPs = mPowerUPs;
+	snapshot.particles = *mBallParticles;
+
+	// the changes stay pending until the render thread applied a
+	// snapshot carrying them: a skipped snapshot loses none and the
+	// newest snapshot has them all, in order
+	auto applied = mAppliedChanges.load(std::memory_order_acquire);
+	std::erase_if(mPendingChanges, [&](const auto &c) {
+		return c.sequence <= applied;
+	});
+	for (unsigned l = 0; l < mLevels.size(); ++l)
+	{
+		auto &level = mLevels[l];
+		for (auto i : level.dirty)
+		{
+			mPendingChanges.push_back({l, i, level.blocks[i].dead, ++mChangeSequence});
+		}
+		level.dirty.clear();
+	}
+	snapshot.changes = mPendingChanges;
+
+	snapshot.chaos = mChaos;
+	snapshot.confuse = mConfuse;
+	snapshot.shake = mShake;
+	snapshot.vsync = mVSync;
+	snapshot.antialiasing = mAntialiasing;
+	snapshot.showProfiler = mShowProfiler;
+	snapshot.showHud = mShowHud;
+	snapshot.tickTime = mTickTime;
+	snapshot.audioSources = mAudioDevice.getActiveSources();
+	snapshot.quit = mQuit;
+	mSnapshots.publish();
+}
+
+void
+Game::acquire()
+{
+	if (!mSnapshots.acquire())
+	{
+		return;
+	}
+
+	const auto &snapshot = mSnapshots.getFront();
+	auto applied = mAppliedChanges.load(std::memory_order_relaxed);
+	for (const auto &c : snapshot.changes)
+	{
+		if (c.sequence <= applied)
+		{
+			continue;
+		}
+		auto &level = mSceneLevels[c.level];
+		level.blocks[c.index].dead = c.dead;
+		level.dirty.push_back(c.index);
+		applied = c.sequence;
+	}
+	mAppliedChanges.store(applied, std::memory_order_release);
+
+	mEffects->Chaos = snapshot.chaos;
+	mEffects->Confuse = snapshot.confuse;
+	mEffects->Shake = snapshot.shake;
+	if (snapshot.vsync != mSceneVSync)
+	{
+		mSceneVSync = snapshot.vsync;
+		mPacer.setVSync(mSceneVSync);
+	}
+	if (snapshot.antialiasing != mSceneAntialiasing)
+	{
+		mSceneAntialiasing = snapshot.antialiasing;
+		mEffects->setAntialiasing(mSceneAntialiasing);
+	}
+	if (snapshot.quit && mWindow)
+	{
+		glfwSetWindowShouldClose(mWindow, GLFW_TRUE);
 	}
 }
 
 void
 Game::processInput()
 {
-	mEventQueue.poll();
+	PROFILE_ZONE("Game::processInput");
 	Event event;
 	while (mEventQueue.pop(event))
 	{
@@ -164,6 +514,30 @@ Game::processInput()
 void
 Game::handleEvent(const Event &event)
 {
+	// keys held to control the paddle
+	if (const auto ep(std::get_if<KeyPressed>(&event)); ep)
+	{
+		switch (ep->key)
+		{
+		case GLFW_KEY_A: mMoveLeft = true; break;
+		case GLFW_KEY_D: mMoveRight = true; break;
+		case GLFW_KEY_SPACE: mLaunch = true; break;
+		case GLFW_KEY_F1: mShowProfiler = !mShowProfiler; break;
+		case GLFW_KEY_F2: PROFILE_CAPTURE("trace.json", TraceFrames); break;
+		case GLFW_KEY_F3: mShowHud = !mShowHud; break;
+		case GLFW_KEY_F4: mAntialiasing = nextAntialiasing(mAntialiasing); break;
+		}
+	}
+	else if (const auto ep(std::get_if<KeyReleased>(&event)); ep)
+	{
+		switch (ep->key)
+		{
+		case GLFW_KEY_A: mMoveLeft = false; break;
+		case GLFW_KEY_D: mMoveRight = false; break;
+		case GLFW_KEY_SPACE: mLaunch = false; break;
+		}
+	}
+
 	switch (mState)
 	{
 	case State::Active:
@@ -172,7 +546,7 @@ Game::handleEvent(const Event &event)
 			switch (ep->key)
 			{
 			case GLFW_KEY_ESCAPE:
-				glfwSetWindowShouldClose(ep->window, GLFW_TRUE);
+				mQuit = true;
 				break;
 			default:
 				break;
@@ -193,8 +567,13 @@ Game::handleEvent(const Event &event)
 			case GLFW_KEY_S:
 				mCurrentLevel = (mCurrentLevel + mLevels.size()-1) % mLevels.size();
 				break;
+			case GLFW_KEY_V:
+				mVSync = mVSync == FramePacer::VSync::Off
+					? FramePacer::VSync::Adaptive
+					: FramePacer::VSync::Off;
+				break;
 			case GLFW_KEY_ESCAPE:
-				glfwSetWindowShouldClose(ep->window, GLFW_TRUE);
+				mQuit = true;
 				break;
 			}
 		}
@@ -205,11 +584,11 @@ Game::handleEvent(const Event &event)
 			switch (ep->key)
 			{
 			case GLFW_KEY_ENTER:
-				mEffects->Chaos = false;
+				mChaos = false;
 				mState = State::Menu;
 				break;
 			case GLFW_KEY_ESCAPE:
-				glfwSetWindowShouldClose(ep->window, GLFW_TRUE);
+				mQuit = true;
 				break;
 			}
 		}
@@ -220,6 +599,7 @@ Game::handleEvent(const Event &event)
 void
 Game::update(GLfloat dt)
 {
+	PROFILE_ZONE("Game::update");
 	if (mState != State::Active)
 	{
 		return;
@@ -227,7 +607,7 @@ Game::update(GLfloat dt)
 
 	// update the paddle
 	auto vel = PlayerVelocity * dt;
-	if (glfwGetKey(mWindow, GLFW_KEY_A) == GLFW_PRESS)
+	if (mMoveLeft)
 	{
 		if (mPlayer.pos.x >= 0.f)
 		{
@@ -239,7 +619,7 @@ Game::update(GLfloat dt)
 		}
 	}
 
-	if (glfwGetKey(mWindow, GLFW_KEY_D) == GLFW_PRESS)
+	if (mMoveRight)
 	{
 		if (mPlayer.pos.x + mPlayer.size.x < ScreenWidth)
 		{
@@ -250,7 +630,7 @@ Game::update(GLfloat dt)
 			}
 		}
 	}
-	if (glfwGetKey(mWindow, GLFW_KEY_SPACE) == GLFW_PRESS)
+	if (mLaunch)
 	{
 		mBall.stuck = false;
 	}
@@ -296,7 +676,7 @@ Game::update(GLfloat dt)
 	// update the effects
 	if (!mShakeEffect.update(dt))
 	{
-		mEffects->Shake = false;
+		mShake = false;
 	}
 	if (!mStickyEffect.update(dt))
 	{
@@ -308,11 +688,11 @@ Game::update(GLfloat dt)
 	}
 	if (!mConfuseEffect.update(dt))
 	{
-		mEffects->Confuse = false;
+		mConfuse = false;
 	}
 	if (!mChaosEffect.update(dt))
 	{
-		mEffects->Chaos = false;
+		mChaos = false;
 	}
 
 	if (mBall.pos.y >= ScreenHeight)
@@ -337,64 +717,181 @@ Game::update(GLfloat dt)
 	{
 		resetLevel();
 		resetPlayer();
-		mEffects->Chaos = true;
+		mChaos = true;
 		mState = State::Win;
 	}
 }
 
 void Game::render()
 {
+	PROFILE_ZONE("Game::render");
+	const auto &scene = mSnapshots.getFront();
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, GLState::getDefaultFramebuffer());
+	mGpuProfiler->beginFrame();
+	if (mOptions.renderScale <= 0.f && !mOptions.headless)
+	{
+		mEffects->setRenderScale(mScaler.update(mGpuProfiler->getFrameTime()));
+	}
+	mRenderer->beginFrame();
 	mRenderer->clear(glm::vec4(0.f, 0.f, .2f, 1.f));
 
 	auto &font = mFonts.get(FontID::Title);
-	if (mState == State::Active || mState == State::Menu)
+	if (scene.state == State::Active || scene.state == State::Menu)
 	{
+		mGpuProfiler->begin("scene");
 		mEffects->beginRender();
 
 		auto background = mTextures.get(TextureID::Background);
 		mRenderer->draw(background,
 		                glm::vec2(0.0f),
-		                glm::vec2(ScreenWidth, ScreenHeight));
+		                glm::vec2(ScreenWidth, ScreenHeight),
+		                glm::vec3(1.0f),
+		                Renderer::Layer::Background);
 
-		mRenderer->draw(mLevels[mCurrentLevel]);
+		mRenderer->draw(mSceneLevels[scene.level]);
 
-		mRenderer->draw(mPlayer);
+		mRenderer->draw(scene.player);
 
-		for (const auto &p : mPowerUPs)
+		for (const auto &p : scene.powerUPs)
 		{
 			mRenderer->draw(p);
 		}
 
-		mRenderer->draw(*mBallParticles);
+		mRenderer->draw(scene.particles);
 
-		mRenderer->draw(mBall);
+		mRenderer->draw(scene.ball);
 
-		mEffects->endRender();
+		mRenderer->flush();
+		mGpuProfiler->end();
 
-		mRenderer->draw(*mEffects, glfwGetTime());
+		{
+			GpuProfiler::Scope scope(*mGpuProfiler, "resolve");
+			mEffects->endRender();
+		}
+		{
+			GpuProfiler::Scope scope(*mGpuProfiler, "postprocess");
+			// the headless frames are timed by the simulation to be
+			// repeatable
+			double time = mWindow ? glfwGetTime()
+			                      : mHeadlessFrame * std::chrono::duration<double>(TickTime).count();
+			mRenderer->draw(*mEffects, time);
+		}
 
-		std::stringstream ss;
-		ss << "Lives: " << mLives;
-		mRenderer->draw(ss.str(), {5.0f, 5.0f}, font);
+		mRenderer->draw("Lives: " + std::to_string(scene.lives), {5.0f, 5.0f}, font);
 	}
 
-	if (mState == State::Menu)
+	if (scene.state == State::Menu)
 	{
-		mRenderer->draw("Press ENTER to start", {250.0f, ScreenHeight / 2}, font);
+		mRenderer->draw(U"Press ENTER to start", {250.0f, ScreenHeight / 2}, font);
 
 		auto &small = mFonts.get(FontID::Subtitle);
-		mRenderer->draw("Press W or S to select level", {245.0f, ScreenHeight/2 + 20.0f}, small);
+		mRenderer->draw(U"Press W or S to select level", {245.0f, ScreenHeight/2 + 20.0f}, small);
 	}
 
-	if (mState == State::Win)
+	if (scene.state == State::Win)
 	{
-		mRenderer->draw("You WON!!!",
+		mRenderer->draw(U"You WON!!!",
 		                      {320.0f, ScreenHeight / 2 - 20.0f},
 		                      font, glm::vec3(0.0f, 1.0f, 0.0f));
-		mRenderer->draw("Press ENTER to retry or ESC to quit",
+		mRenderer->draw(U"Press ENTER to retry or ESC to quit",
 		                     {130.0f, ScreenHeight / 2,},
 		                     font, glm::vec3(1.0f, 1.0f, 0.0f));
 	}
+
+	if (scene.showProfiler)
+	{
+		drawProfiler();
+	}
+	if (scene.showHud)
+	{
+		drawHud();
+	}
+
+	{
+		// the text queued since the postprocess pass
+		GpuProfiler::Scope scope(*mGpuProfiler, "overlay");
+		mRenderer->endFrame();
+	}
+	mGpuProfiler->endFrame();
+}
+
+void
+Game::drawHud()
+{
+	PROFILE_ZONE("Game::drawHud");
+	typedef std::chrono::steady_clock Clock;
+	auto start = Clock::now();
+	const auto &scene = mSnapshots.getFront();
+	const auto &particles = scene.particles.getParticles();
+	auto &title = mFonts.get(FontID::Title);
+	auto &small = mFonts.get(FontID::Subtitle);
+
+	Hud::Sample sample;
+	sample.frameTime = mPacer.getFrameTime();
+	sample.tickTime = scene.tickTime;
+	sample.renderer = mRenderer->getStats();
+	sample.particles = std::count_if(particles.begin(), particles.end(),
+	                                 [](const auto &p) { return p.life > 0.f; });
+	sample.audioSources = scene.audioSources;
+	sample.glyphOccupancy = std::max(title.getOccupancy(), small.getOccupancy());
+	sample.gpuTime = mGpuProfiler->getFrameTime() / 1000.0;
+	sample.renderScale = mEffects->getRenderScale();
+	// GL_MAX_SAMPLES may cap the multisampling below the mode
+	auto samples = mEffects->getSamples();
+	if (samples > 1)
+	{
+		sample.antialiasing = "msaa" + std::to_string(samples);
+	}
+	else
+	{
+		auto mode = mEffects->getAntialiasing() == Postprocess::Antialiasing::FXAA
+			? Postprocess::Antialiasing::FXAA
+			: Postprocess::Antialiasing::None;
+		sample.antialiasing = Postprocess::getName(mode);
+	}
+	sample.hudTime = mHudTime;
+	mHud.update(sample, mPacer);
+	mHud.draw(*mRenderer, small, {5.0f, 35.0f}, mPacer);
+
+	// shown on the next refresh, the overlay must stay cheap
+	mHudTime = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void
+Game::drawProfiler()
+{
+	auto &font = mFonts.get(FontID::Subtitle);
+	glm::vec2 pos(ScreenWidth - 300.0f, 5.0f);
+	for (const auto &t : mGpuProfiler->getTimings())
+	{
+		std::ostringstream ss;
+		ss << std::fixed << std::setprecision(2)
+		   << t.name << ": " << t.average << " ms (p95 " << t.p95 << ")";
+		mRenderer->draw(ss.str(), pos, font, glm::vec3(1.0f, 1.0f, 0.0f));
+		pos.y += 20.0f;
+	}
+}
+
+void
+Game::updatePacing()
+{
+	// the static screens don't need more than a few frames per
+	// second, without vsync the game runs at the monitor rate
+	const auto &scene = mSnapshots.getFront();
+	double fps = 0.0;
+	if (scene.state != State::Active)
+	{
+		fps = MenuFPS;
+	}
+	else if (mPacer.getVSync() == FramePacer::VSync::Off)
+	{
+		fps = mRefreshRate;
+	}
+	mPacer.setTargetFPS(fps);
+
+	// the resolution of the scene drops when the GPU cannot keep
+	// up with the monitor
+	mScaler.setTargetFrameTime(1000.0 / mRefreshRate);
 }
 
 bool
@@ -427,18 +924,30 @@ Game::loadLevel(const std::filesystem::path &path, Level &level)
 
 	auto height = tileData.size();
 	auto width = tileData[0].size();
-	float unit_width = static_cast<float>(ScreenWidth / width);
-	float unit_height = static_cast<float>(ScreenHeight / 2 / height);
+	// whole pixels while the grid fits the screen, the larger
+	// grids get fractional blocks rather than empty ones
+	float unit_width = width <= ScreenWidth
+		? static_cast<float>(ScreenWidth / width)
+		: static_cast<float>(ScreenWidth) / width;
+	float unit_height = height <= ScreenHeight / 2
+		? static_cast<float>(ScreenHeight / 2 / height)
+		: static_cast<float>(ScreenHeight / 2) / height;
 	level.blockSize = glm::vec2(unit_width, unit_height);
 
-	float offset = static_cast<float>((ScreenWidth % width) / 2);
+	float offset = width <= ScreenWidth
+		? static_cast<float>((ScreenWidth % width) / 2)
+		: 0.f;
+	level.columns = width;
+	level.rows = height;
+	level.origin = glm::vec2(offset, 0.f);
 	glm::vec2 pos(0.f);
 	for (decltype(height) y = 0; y < height; ++y, pos.y += unit_height)
 	{
 		pos.x = offset;
 		for (decltype(width) x = 0; x < width; ++x, pos.x += unit_width)
 		{
-			Block b{pos, tileData[y][x], false, false};
+			Block b{pos, tileData[y][x], false, false,
+			        glm::uvec2(static_cast<unsigned>(x), static_cast<unsigned>(y))};
 
 			switch (b.type)
 			{
@@ -458,9 +967,14 @@ Game::loadLevel(const std::filesystem::path &path, Level &level)
 void
 Game::resetLevel()
 {
-	for (auto &block : mLevels[mCurrentLevel].blocks)
+	auto &level = mLevels[mCurrentLevel];
+	for (std::size_t i = 0; i < level.blocks.size(); ++i)
 	{
-		block.dead = false;
+		if (level.blocks[i].dead)
+		{
+			level.blocks[i].dead = false;
+			level.dirty.push_back(i);
+		}
 	}
 	mLives = InitialLives;
 }
@@ -489,9 +1003,9 @@ Game::resetPlayer()
 	mChaosEffect.disable();
 	mConfuseEffect.disable();
 
-	mEffects->Chaos = false;
-	mEffects->Confuse = false;
-	mEffects->Shake = false;
+	mChaos = false;
+	mConfuse = false;
+	mShake = false;
 }
 
 void
@@ -517,14 +1031,14 @@ Game::activatePowerUP(enum PowerUP::Type type)
 		if (!mChaosEffect.isEnabled())
 		{
 			mConfuseEffect.enableFor(15.f);
-			mEffects->Confuse = true;
+			mConfuse = true;
 		}
 		break;
 	case PowerUP::Chaos:
 		if (!mConfuseEffect.isEnabled())
 		{
 			mChaosEffect.enableFor(15.f);
-			mEffects->Chaos = true;
+			mChaos = true;
 		}
 		break;
 	}
@@ -600,9 +1114,11 @@ checkCollision(const Paddle &a, const PowerUP &b)
 void
 Game::doCollisions()
 {
+	PROFILE_ZONE("Game::doCollisions");
 	// ball bricks collision
-	glm::vec2 size = mLevels[mCurrentLevel].blockSize;
-	for (auto &obj : mLevels[mCurrentLevel].blocks)
+	auto &level = mLevels[mCurrentLevel];
+	glm::vec2 size = level.blockSize;
+	for (auto &obj : level.blocks)
 	{
 		if (obj.dead)
 		{
@@ -617,13 +1133,14 @@ Game::doCollisions()
 		if (!obj.solid)
 		{
 			obj.dead = true;
+			level.dirty.push_back(&obj - level.blocks.data());
 			spawnPowerUPs(obj.position);
 			mAudioDevice.play(SoundID::Block);
 		}
 		else
 		{
 			mShakeEffect.enableFor(0.05f);
-			mEffects->Shake = true;
+			mShake = true;
 			mAudioDevice.play(SoundID::Solid);
 		}
 
@@ -711,37 +1228,37 @@ Game::spawnPowerUPs(glm::vec2 pos)
 	{
 		pow.type = PowerUP::Speed;
 		pow.color = glm::vec3(0.5f, 0.5f, 1.0f);
-		pow.texture = mTextures.get(TextureID::PowerupSpeed);
+		pow.texture = mAtlas.get(TextureID::PowerupSpeed);
 	}
 	else if (shouldSpawn(75))
 	{
 		pow.type = PowerUP::Sticky;
 		pow.color = glm::vec3(1.0f, 0.5f, 1.0f);
-		pow.texture = mTextures.get(TextureID::PowerupSticky);
+		pow.texture = mAtlas.get(TextureID::PowerupSticky);
 	}
 	else if (shouldSpawn(75))
 	{
 		pow.type = PowerUP::PassThrough;
 		pow.color = glm::vec3(0.5f, 1.0f, 0.5f);
-		pow.texture = mTextures.get(TextureID::PowerupPassthrough);
+		pow.texture = mAtlas.get(TextureID::PowerupPassthrough);
 	}
 	else if (shouldSpawn(75))
 	{
 		pow.type = PowerUP::PadIncrease;
 		pow.color = glm::vec3(1.0f, 0.6f, 0.4f);
-		pow.texture = mTextures.get(TextureID::PowerupIncrease);
+		pow.texture = mAtlas.get(TextureID::PowerupIncrease);
 	}
 	else if (shouldSpawn(15))
 	{
 		pow.type = PowerUP::Confuse;
 		pow.color = glm::vec3(1.0f, 0.3f, 0.3f);
-		pow.texture = mTextures.get(TextureID::PowerupConfuse);
+		pow.texture = mAtlas.get(TextureID::PowerupConfuse);
 	}
 	else if (shouldSpawn(15))
 	{
 		pow.type = PowerUP::Chaos;
 		pow.color = glm::vec3(0.9f, 0.25f, 0.25f);
-		pow.texture = mTextures.get(TextureID::PowerupChaos);
+		pow.texture = mAtlas.get(TextureID::PowerupChaos);
 	}
 	else
 	{
@@ -760,8 +1277,16 @@ Game::loadAssets()
 {
         // textures
 	static constexpr std::pair<TextureID, std::string_view> textures[] = {
-		{ TextureID::Face, "assets/textures/awesomeface.png" },
 		{ TextureID::Background, "assets/textures/background.jpg" },
+	};
+	for (auto [id, path] : textures)
+	{
+		mTextures.load(id, path);
+	}
+
+	// sprites packed in the atlas
+	static constexpr std::pair<TextureID, std::string_view> sprites[] = {
+		{ TextureID::Face, "assets/textures/awesomeface.png" },
 		{ TextureID::Blocks, "assets/textures/blocks.png" },
 		{ TextureID::Paddle, "assets/textures/paddle.png" },
 		{ TextureID::Particle, "assets/textures/particle.png" },
@@ -772,21 +1297,46 @@ Game::loadAssets()
 		{ TextureID::PowerupChaos, "assets/textures/powerup_chaos.png" },
 		{ TextureID::PowerupPassthrough, "assets/textures/powerup_passthrough.png" },
 	};
-	for (auto [id, path] : textures)
+	for (auto [id, path] : sprites)
 	{
-		mTextures.load(id, path);
+		if (!mAtlas.add(id, path))
+		{
+			throw std::runtime_error("Game::loadAssets(): "
+			                         "Failed to load " + std::string(path));
+		}
+	}
+	if (!mAtlas.pack())
+	{
+		throw std::runtime_error("Game::loadAssets(): "
+		                         "Failed to pack the texture atlas");
 	}
 
-	// shaders
+	// shaders, all share the Frame block and the scene helpers
+	static constexpr std::string_view frameHeader = "assets/shaders/frame.glsl";
 	static constexpr std::tuple<ShaderID, std::string_view, std::string_view> shaders[] = {
-		{ ShaderID::Postprocess, "assets/shaders/postprocess.vs", "assets/shaders/postprocess.fs" },
-		{ ShaderID::Texture, "assets/shaders/simple.vs", "assets/shaders/texture.fs" },
-		{ ShaderID::UniformColor, "assets/shaders/simple.vs", "assets/shaders/uniformcolor.fs" },
+		{ ShaderID::Tilemap, "assets/shaders/vertexcolor.vs", "assets/shaders/tilemap.fs" },
 		{ ShaderID::VertexColor, "assets/shaders/vertexcolor.vs", "assets/shaders/vertexcolor.fs" },
 	};
 	for (auto [id, vs, fs] : shaders)
 	{
-		mShaders.load(id, vs, fs);
+		mShaders.load(id, vs, fs, frameHeader);
+	}
+	if (!mPostShaders.loadFromFile("assets/shaders/postprocess.vs",
+	                               "assets/shaders/postprocess.fs",
+	                               frameHeader,
+	                               Postprocess::getShaderFeatures(),
+	                               Postprocess::reduceEffects))
+	{
+		throw std::runtime_error("Game::loadAssets(): "
+		                         "Failed to load the postprocess shaders");
+	}
+	if (!mBlurShaders.loadFromFile("assets/shaders/postprocess.vs",
+	                               "assets/shaders/blur.fs",
+	                               frameHeader,
+	                               { "VERTICAL" }))
+	{
+		throw std::runtime_error("Game::loadAssets(): "
+		                         "Failed to load the blur shaders");
 	}
 
 	// fonts
@@ -796,7 +1346,7 @@ Game::loadAssets()
 	};
 	for (auto [id, path, size] : fonts)
 	{
-		mFonts.load(id, path, size);
+		mFonts.load(id, path, size, FontCharset, FontCacheDir);
 	}
 
 	// sound buffers
@@ -810,6 +1360,9 @@ Game::loadAssets()
 	};
 	for (auto [id, path] : sounds)
 	{
-		mAudioDevice.load(id, path);
+		if (mAudioDevice.isOpen())
+		{
+			mAudioDevice.load(id, path);
+		}
 	}
 }
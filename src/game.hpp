@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
 #include <vector>
 #include <memory>
 
@@ -10,17 +13,40 @@
 #include "effect.hpp"
 #include "entities.hpp"
 #include "eventqueue.hpp"
+#include "framepacer.hpp"
+#include "headlesscontext.hpp"
+#include "hud.hpp"
 #include "resources.hpp"
+#include "particle.hpp"
+#include "postprocess.hpp"
+#include "resolutionscaler.hpp"
 #include "resourceholder.hpp"
+#include "shader.hpp"
+#include "texture.hpp"
+#include "textureatlas.hpp"
+#include "triplebuffer.hpp"
 
-class ParticleGen;
-class Postprocess;
+class GpuProfiler;
 class Renderer;
 
+struct GameOptions
+{
+	// render without a display into an offscreen framebuffer
+	bool headless = false;
+	unsigned frames = 600;
+	// directory receiving the frames as PNG files, if not empty
+	std::filesystem::path dumpPath;
+	// fixed resolution scale of the scene, 0 lets the GPU time of
+	// the frames pick it; the headless runs default to 1
+	float renderScale = 0.f;
+	// also switched at runtime with F4
+	Postprocess::Antialiasing antialiasing = Postprocess::Antialiasing::MSAA8;
+};
+
 class Game
 {
 public:
-	Game();
+	explicit Game(const GameOptions &options = GameOptions());
 	~Game();
 
 	void run();
@@ -31,10 +57,21 @@ public:
 	void render();
 
 private:
+	void runHeadless();
+	void createWindow();
+	void createOffscreenTarget();
+	void dumpFrame(unsigned frame);
+	void drawProfiler();
+	void drawHud();
+	void simulate();
+	void publish();
+	void acquire();
+
 	void loadAssets();
 	bool loadLevel(const std::filesystem::path &path, Level &level);
 	void resetLevel();
 	void resetPlayer();
+	void updatePacing();
 
 	void doCollisions();
 
@@ -48,9 +85,47 @@ private:
 		Active,
 		Menu,
 		Win,
-	} mState;
+	};
 
-	// world data
+	// change of a block of a level, numbered in the order of the
+	// simulation
+	struct BlockChange
+	{
+		unsigned level;
+		std::size_t index;
+		bool dead;
+		std::uint64_t sequence;
+	};
+
+	// what the render thread needs of the world, published by
+	// the simulation thread after each tick
+	struct Snapshot
+	{
+		State state;
+		unsigned level;
+		unsigned lives;
+		Paddle player;
+		Ball ball;
+		std::vector<PowerUP> powerUPs;
+		ParticleGen particles;
+
+		// the changes not applied by the render thread yet
+		std::vector<BlockChange> changes;
+
+		bool chaos;
+		bool confuse;
+		bool shake;
+		FramePacer::VSync vsync;
+		Postprocess::Antialiasing antialiasing;
+		bool showProfiler;
+		bool showHud;
+		double tickTime;
+		unsigned audioSources;
+		bool quit;
+	};
+
+	// simulation thread data
+	State mState;
 	std::vector<Level> mLevels;
 	std::vector<PowerUP> mPowerUPs;
 	Paddle mPlayer;
@@ -66,19 +141,63 @@ private:
 	Effect mPassThroughEffect;
 	Effect mConfuseEffect;
 	Effect mChaosEffect;
+	bool mChaos;
+	bool mConfuse;
+	bool mShake;
+
+	// held keys
+	bool mMoveLeft;
+	bool mMoveRight;
+	bool mLaunch;
+
+	FramePacer::VSync mVSync;
+	Postprocess::Antialiasing mAntialiasing;
+	bool mShowProfiler;
+	bool mShowHud;
+	double mTickTime;
+	bool mQuit;
+	std::unique_ptr<ParticleGen> mBallParticles;
+	std::vector<BlockChange> mPendingChanges;
+	std::uint64_t mChangeSequence;
+
+	// shared data
+	TripleBuffer<Snapshot> mSnapshots;
+	std::atomic<bool> mRunning;
+	// sequence of the last block change applied by the render thread
+	std::atomic<std::uint64_t> mAppliedChanges;
+
+	// render thread data
+	std::vector<Level> mSceneLevels;
+	FramePacer::VSync mSceneVSync;
+	Postprocess::Antialiasing mSceneAntialiasing;
+	// refresh rate of the primary monitor
+	double mRefreshRate;
+	Hud mHud;
+	// CPU time of the last drawHud() in seconds
+	double mHudTime;
 
 	// graphics rendering data
+	GameOptions mOptions;
 	GLFWwindow *mWindow;
+	HeadlessContext mHeadlessContext;
+	unsigned mHeadlessFrame;
+	GLuint mOffscreenFBO;
+	Texture2D mOffscreenTexture;
 	std::unique_ptr<Renderer> mRenderer;
-	std::unique_ptr<ParticleGen> mBallParticles;
 	std::unique_ptr<Postprocess> mEffects;
+	std::unique_ptr<GpuProfiler> mGpuProfiler;
+	FramePacer mPacer;
+	ResolutionScaler mScaler;
 
-	// audio
+	// audio, played by the simulation thread
 	AudioDevice mAudioDevice;
 
 	// support data
 	EventQueue mEventQueue;
 	TextureHolder mTextures;
+	TextureAtlas mAtlas;
 	ShaderHolder mShaders;
+	ShaderVariants mPostShaders;
+	ShaderVariants mBlurShaders;
 	FontHolder mFonts;
 };
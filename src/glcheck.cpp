@@ -3,6 +3,47 @@
 
 #include "glcheck.hpp"
 
+#if ERROR_CHECK_LEVEL == ERROR_CHECK_CALLBACK
+namespace
+{
+static const char *
+sourceName(GLenum source)
+{
+	switch (source)
+	{
+	case GL_DEBUG_SOURCE_API:             return "API";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY:     return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION:     return "application";
+	default:                              return "other";
+	}
+}
+
+static const char *
+severityName(GLenum severity)
+{
+	switch (severity)
+	{
+	case GL_DEBUG_SEVERITY_HIGH:         return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM:       return "medium";
+	case GL_DEBUG_SEVERITY_LOW:          return "low";
+	case GL_DEBUG_SEVERITY_NOTIFICATION: return "notification";
+	default:                             return "unknown";
+	}
+}
+
+static void GLAPIENTRY
+debugCallback(GLenum source, GLenum, GLuint id, GLenum severity,
+              GLsizei, const GLchar *message, const void *)
+{
+	std::cerr << "OpenGL debug message (" << sourceName(source)
+	          << ", " << severityName(severity) << ", id " << id
+	          << "):\n" << message << "\n";
+}
+}
+#endif
+
 void glCheckError(const std::filesystem::path &file,
                   unsigned line,
                   std::string_view expression)
@@ -51,3 +92,57 @@ void glCheckError(const std::filesystem::path &file,
 	          << expression << "\nError description:\n"
 	          << err << "\n" << desc << "\n";
 }
+
+void glInitDebugOutput(GLenum minSeverity, GLenum source)
+{
+#if ERROR_CHECK_LEVEL == ERROR_CHECK_CALLBACK
+	static const GLenum severities[] = {
+		GL_DEBUG_SEVERITY_HIGH,
+		GL_DEBUG_SEVERITY_MEDIUM,
+		GL_DEBUG_SEVERITY_LOW,
+		GL_DEBUG_SEVERITY_NOTIFICATION,
+	};
+
+	// the messages are delivered asynchronously: we don't enable
+	// GL_DEBUG_OUTPUT_SYNCHRONOUS to avoid stalling the driver
+	if (GLEW_KHR_debug)
+	{
+		glCheck(glEnable(GL_DEBUG_OUTPUT));
+		glCheck(glDebugMessageCallback(debugCallback, nullptr));
+		glCheck(glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE,
+		                              0, nullptr, GL_FALSE));
+		for (auto severity : severities)
+		{
+			glCheck(glDebugMessageControl(source, GL_DONT_CARE, severity,
+			                              0, nullptr, GL_TRUE));
+			if (severity == minSeverity)
+			{
+				break;
+			}
+		}
+	}
+	else if (GLEW_ARB_debug_output)
+	{
+		glCheck(glDebugMessageCallbackARB(debugCallback, nullptr));
+		glCheck(glDebugMessageControlARB(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE,
+		                                 0, nullptr, GL_FALSE));
+		for (auto severity : severities)
+		{
+			glCheck(glDebugMessageControlARB(source, GL_DONT_CARE, severity,
+			                                 0, nullptr, GL_TRUE));
+			if (severity == minSeverity)
+			{
+				break;
+			}
+		}
+	}
+	else
+	{
+		std::cerr << "glInitDebugOutput() - KHR_debug and ARB_debug_output"
+		          << " not available, the errors will not be reported\n";
+	}
+#else
+	(void)minSeverity;
+	(void)source;
+#endif
+}
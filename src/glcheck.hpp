@@ -3,7 +3,11 @@
 #include <filesystem>
 #include <string_view>
 
-#ifndef NDEBUG
+#include <GL/glew.h>
+
+#include "errorcheck.hpp"
+
+#if ERROR_CHECK_LEVEL == ERROR_CHECK_SYNC
 #define glCheck(expr) do { expr; glCheckError(__FILE__, __LINE__, #expr); } while (0)
 #else
 #define glCheck(expr) do { expr; } while (0)
@@ -12,3 +16,9 @@
 void glCheckError(const std::filesystem::path &file,
                   unsigned int line,
                   std::string_view expression);
+
+// install the debug message callback when the checks are in
+// callback mode: the messages from the given source (GL_DONT_CARE
+// for all) with at least minSeverity are printed.
+void glInitDebugOutput(GLenum minSeverity = GL_DEBUG_SEVERITY_LOW,
+                       GLenum source = GL_DONT_CARE);
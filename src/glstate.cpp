@@ -0,0 +1,262 @@
+#include <algorithm>
+
+#include "glcheck.hpp"
+#include "glstate.hpp"
+
+namespace
+{
+// value that never matches a real binding
+static constexpr GLuint Unknown = -2U;
+static constexpr unsigned MaxTextureUnits = 16;
+
+struct State
+{
+	GLuint program = Unknown;
+	unsigned activeUnit = Unknown;
+	GLuint textures[MaxTextureUnits];
+	GLuint vertexArray = Unknown;
+	GLuint arrayBuffer = Unknown;
+	GLuint elementBuffer = Unknown;
+	GLenum blendSrc = GL_NONE;
+	GLenum blendDst = GL_NONE;
+	GLuint readFramebuffer = Unknown;
+	GLuint drawFramebuffer = Unknown;
+
+	State()
+	{
+		std::fill(std::begin(textures), std::end(textures), Unknown);
+	}
+};
+
+State state;
+GLState::Stats stats;
+GLuint defaultFramebuffer = 0;
+
+static inline bool
+update(GLState::Counter &counter, GLuint &current, GLuint value)
+{
+	if (current == value)
+	{
+		counter.skipped++;
+		return false;
+	}
+	counter.issued++;
+	current = value;
+	return true;
+}
+}
+
+namespace GLState
+{
+void
+useProgram(GLuint program)
+{
+	if (update(stats.program, state.program, program))
+	{
+		glCheck(glUseProgram(program));
+	}
+}
+
+void
+activeTexture(unsigned unit)
+{
+	if (update(stats.activeTexture, state.activeUnit, unit))
+	{
+		glCheck(glActiveTexture(GL_TEXTURE0 + unit));
+	}
+}
+
+void
+bindTexture(GLuint texture)
+{
+	if (state.activeUnit >= MaxTextureUnits)
+	{
+		activeTexture(0);
+	}
+	if (update(stats.texture, state.textures[state.activeUnit], texture))
+	{
+		glCheck(glBindTexture(GL_TEXTURE_2D, texture));
+	}
+}
+
+void
+bindTexture(unsigned unit, GLuint texture)
+{
+	if (unit < MaxTextureUnits && state.textures[unit] == texture)
+	{
+		stats.texture.skipped++;
+		return;
+	}
+	activeTexture(unit);
+	if (unit >= MaxTextureUnits)
+	{
+		stats.texture.issued++;
+		glCheck(glBindTexture(GL_TEXTURE_2D, texture));
+		return;
+	}
+	bindTexture(texture);
+}
+
+void
+bindVertexArray(GLuint vao)
+{
+	if (update(stats.vertexArray, state.vertexArray, vao))
+	{
+		glCheck(glBindVertexArray(vao));
+		// the element buffer binding belongs to the VAO
+		state.elementBuffer = Unknown;
+	}
+}
+
+void
+bindBuffer(GLenum target, GLuint buffer)
+{
+	GLuint *current = nullptr;
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER:
+		current = &state.arrayBuffer;
+		break;
+	case GL_ELEMENT_ARRAY_BUFFER:
+		current = &state.elementBuffer;
+		break;
+	default:
+		stats.buffer.issued++;
+		glCheck(glBindBuffer(target, buffer));
+		return;
+	}
+	if (update(stats.buffer, *current, buffer))
+	{
+		glCheck(glBindBuffer(target, buffer));
+	}
+}
+
+void
+blendFunc(GLenum src, GLenum dst)
+{
+	if (state.blendSrc == src && state.blendDst == dst)
+	{
+		stats.blend.skipped++;
+		return;
+	}
+	stats.blend.issued++;
+	state.blendSrc = src;
+	state.blendDst = dst;
+	glCheck(glBlendFunc(src, dst));
+}
+
+void
+bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	if ((!read || state.readFramebuffer == framebuffer)
+	    && (!draw || state.drawFramebuffer == framebuffer))
+	{
+		stats.framebuffer.skipped++;
+		return;
+	}
+	stats.framebuffer.issued++;
+	if (read)
+	{
+		state.readFramebuffer = framebuffer;
+	}
+	if (draw)
+	{
+		state.drawFramebuffer = framebuffer;
+	}
+	glCheck(glBindFramebuffer(target, framebuffer));
+}
+
+void
+setDefaultFramebuffer(GLuint framebuffer)
+{
+	defaultFramebuffer = framebuffer;
+}
+
+GLuint
+getDefaultFramebuffer()
+{
+	return defaultFramebuffer;
+}
+
+void
+deleteProgram(GLuint program)
+{
+	glCheck(glDeleteProgram(program));
+	if (state.program == program)
+	{
+		state.program = Unknown;
+	}
+}
+
+void
+deleteTexture(GLuint texture)
+{
+	glCheck(glDeleteTextures(1, &texture));
+	for (auto &bound : state.textures)
+	{
+		if (bound == texture)
+		{
+			bound = 0;
+		}
+	}
+}
+
+void
+deleteVertexArray(GLuint vao)
+{
+	glCheck(glDeleteVertexArrays(1, &vao));
+	if (state.vertexArray == vao)
+	{
+		state.vertexArray = 0;
+		state.elementBuffer = Unknown;
+	}
+}
+
+void
+deleteBuffer(GLuint buffer)
+{
+	glCheck(glDeleteBuffers(1, &buffer));
+	if (state.arrayBuffer == buffer)
+	{
+		state.arrayBuffer = 0;
+	}
+	if (state.elementBuffer == buffer)
+	{
+		state.elementBuffer = Unknown;
+	}
+}
+
+void
+deleteFramebuffer(GLuint framebuffer)
+{
+	glCheck(glDeleteFramebuffers(1, &framebuffer));
+	if (state.readFramebuffer == framebuffer)
+	{
+		state.readFramebuffer = 0;
+	}
+	if (state.drawFramebuffer == framebuffer)
+	{
+		state.drawFramebuffer = 0;
+	}
+}
+
+void
+invalidate()
+{
+	state = State();
+}
+
+const Stats &
+getStats()
+{
+	return stats;
+}
+
+void
+resetStats()
+{
+	stats = Stats();
+}
+}
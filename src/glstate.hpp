@@ -0,0 +1,54 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Shadow copy of the OpenGL bindings: the wrappers skip the calls
+// that would set a state that is already current. Objects must be
+// deleted through the cache, otherwise a recycled name could be
+// mistaken for a binding that is still current.
+namespace GLState
+{
+struct Counter
+{
+	unsigned issued;
+	unsigned skipped;
+};
+
+struct Stats
+{
+	Counter program;
+	Counter activeTexture;
+	Counter texture;
+	Counter vertexArray;
+	Counter buffer;
+	Counter blend;
+	Counter framebuffer;
+};
+
+void useProgram(GLuint program);
+void activeTexture(unsigned unit);
+void bindTexture(GLuint texture);
+void bindTexture(unsigned unit, GLuint texture);
+void bindVertexArray(GLuint vao);
+void bindBuffer(GLenum target, GLuint buffer);
+void blendFunc(GLenum src, GLenum dst);
+void bindFramebuffer(GLenum target, GLuint framebuffer);
+
+// framebuffer standing for the window, 0 unless the frames are
+// rendered offscreen
+void setDefaultFramebuffer(GLuint framebuffer);
+GLuint getDefaultFramebuffer();
+
+void deleteProgram(GLuint program);
+void deleteTexture(GLuint texture);
+void deleteVertexArray(GLuint vao);
+void deleteBuffer(GLuint buffer);
+void deleteFramebuffer(GLuint framebuffer);
+
+// forget everything, to be called after third party code
+// changed the state behind our back
+void invalidate();
+
+const Stats &getStats();
+void resetStats();
+}
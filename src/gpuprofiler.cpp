@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cassert>
+
+#include "glcheck.hpp"
+#include "gpuprofiler.hpp"
+
+GpuProfiler::Scope::Scope(GpuProfiler &profiler, std::string_view name)
+	: mProfiler(profiler)
+{
+	mProfiler.begin(name);
+}
+
+GpuProfiler::Scope::~Scope()
+{
+	mProfiler.end();
+}
+
+GpuProfiler::GpuProfiler()
+	: mRegions()
+	, mSlots()
+	, mActive(nullptr)
+	, mFrame(0)
+	, mReported(0)
+	, mFrameTime(0.0)
+{
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	for (auto &r : mRegions)
+	{
+		glCheck(glDeleteQueries(Latency, r.queries.data()));
+	}
+}
+
+GpuProfiler::Region &
+GpuProfiler::getRegion(std::string_view name)
+{
+	auto found = std::find_if(mRegions.begin(), mRegions.end(), [&](const auto &r) {
+		return r.name == name;
+	});
+	if (found != mRegions.end())
+	{
+		return *found;
+	}
+
+	auto &r = mRegions.emplace_back();
+	r.name = name;
+	glCheck(glGenQueries(Latency, r.queries.data()));
+	r.pending.fill(false);
+	r.frames.fill(0);
+	r.count = 0;
+	return r;
+}
+
+void
+GpuProfiler::beginFrame()
+{
+	for (auto &r : mRegions)
+	{
+		for (unsigned i = 0; i < Latency; ++i)
+		{
+			if (!r.pending[i])
+			{
+				continue;
+			}
+			GLint available = GL_FALSE;
+			glCheck(glGetQueryObjectiv(r.queries[i], GL_QUERY_RESULT_AVAILABLE, &available));
+			if (!available)
+			{
+				continue;
+			}
+			GLuint64 elapsed;
+			glCheck(glGetQueryObjectui64v(r.queries[i], GL_QUERY_RESULT, &elapsed));
+			r.samples[r.count++ % History] = elapsed * 1e-6f;
+			r.pending[i] = false;
+			// the slot may have moved on to a later frame
+			if (mSlots[i].frame == r.frames[i])
+			{
+				mSlots[i].time += elapsed * 1e-6;
+				--mSlots[i].pending;
+			}
+		}
+	}
+
+	// several frames can complete at once after a stall, only the
+	// newest one is the current cost of a frame
+	const FrameSlot *newest = nullptr;
+	for (const auto &slot : mSlots)
+	{
+		if (slot.queries > 0 && slot.pending == 0 && slot.frame >= mReported && slot.frame < mFrame
+		    && (!newest || slot.frame > newest->frame))
+		{
+			newest = &slot;
+		}
+	}
+	if (newest)
+	{
+		mFrameTime = newest->time;
+		mReported = newest->frame + 1;
+	}
+}
+
+void
+GpuProfiler::endFrame()
+{
+	assert(!mActive && "a region is still open");
+	++mFrame;
+}
+
+void
+GpuProfiler::begin(std::string_view name)
+{
+	assert(!mActive && "the regions cannot be nested");
+	auto &r = getRegion(name);
+
+	// a result that is still not available after Latency frames
+	// is dropped by reusing its query
+	auto slot = mFrame % Latency;
+	auto &frame = mSlots[slot];
+	if (frame.frame != mFrame)
+	{
+		frame = FrameSlot{mFrame, 0, 0, 0.0};
+	}
+	glCheck(glBeginQuery(GL_TIME_ELAPSED, r.queries[slot]));
+	r.pending[slot] = true;
+	r.frames[slot] = mFrame;
+	++frame.queries;
+	++frame.pending;
+	mActive = &r;
+}
+
+void
+GpuProfiler::end()
+{
+	assert(mActive && "no region is open");
+	glCheck(glEndQuery(GL_TIME_ELAPSED));
+	mActive = nullptr;
+}
+
+double
+GpuProfiler::getFrameTime() const
+{
+	return mFrameTime;
+}
+
+std::vector<GpuProfiler::Timing>
+GpuProfiler::getTimings() const
+{
+	std::vector<Timing> timings;
+	std::vector<float> sorted;
+	for (const auto &r : mRegions)
+	{
+		Timing t{r.name, 0.0, 0.0, 0.0, 0.0};
+		auto count = std::min(r.count, History);
+		if (count > 0)
+		{
+			sorted.assign(r.samples.begin(), r.samples.begin() + count);
+			std::sort(sorted.begin(), sorted.end());
+			for (auto s : sorted)
+			{
+				t.average += s;
+			}
+			t.average /= count;
+			t.median = sorted[count / 2];
+			t.p95 = sorted[count * 95 / 100];
+			t.maximum = sorted.back();
+		}
+		timings.push_back(t);
+	}
+	return timings;
+}
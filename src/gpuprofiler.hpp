@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Measures the GPU time of regions of the frame with
+// GL_TIME_ELAPSED queries. Each region owns a query per frame in
+// flight: the results are collected a few frames later, once they
+// are available, so that reading them never stalls the pipeline.
+//
+// Only one region can be measured at a time, the regions cannot
+// be nested.
+class GpuProfiler
+{
+public:
+	static constexpr unsigned Latency = 4;
+	static constexpr unsigned History = 120;
+
+	// GPU time of a region in milliseconds over the last frames
+	struct Timing
+	{
+		std::string_view name;
+		double average;
+		double median;
+		double p95;
+		double maximum;
+	};
+
+	class Scope
+	{
+	public:
+		Scope(GpuProfiler &profiler, std::string_view name);
+		~Scope();
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+	private:
+		GpuProfiler &mProfiler;
+	};
+
+public:
+	GpuProfiler();
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler &) = delete;
+	GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+	// collect the results that are available
+	void beginFrame();
+	void endFrame();
+
+	void begin(std::string_view name);
+	void end();
+
+	std::vector<Timing> getTimings() const;
+	// milliseconds of the regions of the newest frame whose results
+	// have all arrived
+	double getFrameTime() const;
+
+private:
+	struct Region
+	{
+		std::string name;
+		std::array<GLuint, Latency> queries;
+		std::array<bool, Latency> pending;
+		// frame of each query
+		std::array<unsigned, Latency> frames;
+		std::array<float, History> samples;
+		unsigned count;
+	};
+
+	// the results of a frame in flight, summed over its regions
+	struct FrameSlot
+	{
+		unsigned frame;
+		unsigned queries;
+		unsigned pending;
+		double time;
+	};
+
+	Region &getRegion(std::string_view name);
+
+	std::vector<Region> mRegions;
+	std::array<FrameSlot, Latency> mSlots;
+	Region *mActive;
+	unsigned mFrame;
+	// frame after the last one reported
+	unsigned mReported;
+	double mFrameTime;
+};
@@ -0,0 +1,170 @@
+#include <cstring>
+#include <stdexcept>
+
+#if HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "errorcheck.hpp"
+#include "headlesscontext.hpp"
+
+namespace
+{
+#if HAVE_EGL
+bool
+hasExtension(const char *extensions, const char *name)
+{
+	if (!extensions)
+	{
+		return false;
+	}
+	const std::size_t length = std::strlen(name);
+	for (const char *pos = extensions; (pos = std::strstr(pos, name)); pos += length)
+	{
+		if ((pos == extensions || pos[-1] == ' ')
+		    && (pos[length] == ' ' || pos[length] == '\0'))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+EGLDisplay
+getDisplay()
+{
+	const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+		eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (!getPlatformDisplay)
+	{
+		return EGL_NO_DISPLAY;
+	}
+
+	if (hasExtension(extensions, "EGL_MESA_platform_surfaceless"))
+	{
+		EGLDisplay display = getPlatformDisplay(
+			EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		if (display != EGL_NO_DISPLAY)
+		{
+			return display;
+		}
+	}
+
+	// the drivers without the Mesa platform expose their devices
+	auto queryDevices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(
+		eglGetProcAddress("eglQueryDevicesEXT"));
+	if (queryDevices && hasExtension(extensions, "EGL_EXT_platform_device"))
+	{
+		EGLDeviceEXT device;
+		EGLint count = 0;
+		if (queryDevices(1, &device, &count) && count > 0)
+		{
+			return getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+		}
+	}
+	return EGL_NO_DISPLAY;
+}
+#endif
+}
+
+HeadlessContext::HeadlessContext()
+	: mDisplay(nullptr)
+	, mContext(nullptr)
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	destroy();
+}
+
+void
+HeadlessContext::create()
+{
+#if HAVE_EGL
+	EGLDisplay display = getDisplay();
+	if (display == EGL_NO_DISPLAY)
+	{
+		throw std::runtime_error("HeadlessContext: No EGL display without a window system");
+	}
+	if (!eglInitialize(display, nullptr, nullptr))
+	{
+		throw std::runtime_error("HeadlessContext: Failed to initialize EGL");
+	}
+	mDisplay = display;
+
+	const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (!hasExtension(extensions, "EGL_KHR_create_context")
+	    || !hasExtension(extensions, "EGL_KHR_surfaceless_context"))
+	{
+		throw std::runtime_error("HeadlessContext: EGL_KHR_create_context and "
+		                         "EGL_KHR_surfaceless_context required!");
+	}
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		throw std::runtime_error("HeadlessContext: Desktop OpenGL not supported by EGL");
+	}
+
+	// no window surface ever, the default would ask for one
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_NONE,
+	};
+	EGLConfig config;
+	EGLint count = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &count) || count == 0)
+	{
+		throw std::runtime_error("HeadlessContext: No EGL config for OpenGL");
+	}
+
+	// same attributes as the window context
+	EGLint flags = 0;
+#if ERROR_CHECK_LEVEL == ERROR_CHECK_CALLBACK
+	flags |= EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR;
+#endif
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		EGL_CONTEXT_FLAGS_KHR, flags,
+		EGL_NONE,
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+	if (context == EGL_NO_CONTEXT)
+	{
+		throw std::runtime_error("HeadlessContext: Failed to create an OpenGL 3.3 context");
+	}
+	mContext = context;
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		throw std::runtime_error("HeadlessContext: Failed to make the context current");
+	}
+#else
+	throw std::runtime_error("HeadlessContext: Built without EGL");
+#endif
+}
+
+void
+HeadlessContext::destroy()
+{
+#if HAVE_EGL
+	if (mContext)
+	{
+		eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(mDisplay, mContext);
+		mContext = nullptr;
+	}
+	if (mDisplay)
+	{
+		eglTerminate(mDisplay);
+		mDisplay = nullptr;
+	}
+#endif
+}
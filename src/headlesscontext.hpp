@@ -0,0 +1,24 @@
+#pragma once
+
+// OpenGL context of the headless runs, created with EGL without any
+// window system: the display comes from the surfaceless platform of
+// Mesa or from the first EGL device, and no surface is bound. The
+// frames are drawn into an offscreen framebuffer.
+class HeadlessContext
+{
+public:
+	HeadlessContext();
+	~HeadlessContext();
+	HeadlessContext(const HeadlessContext &) = delete;
+	HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+	// creates a 3.3 core context and makes it current, throws when
+	// no display can be initialized
+	void create();
+	void destroy();
+
+private:
+	// EGLDisplay and EGLContext, the EGL headers stay out of here
+	void *mDisplay;
+	void *mContext;
+};
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+#include "font.hpp"
+#include "hud.hpp"
+
+namespace
+{
+// seconds between two refreshes of the text
+static constexpr double RefreshPeriod = 0.25;
+
+// graph scale: pixels per millisecond, and the frame budget
+static constexpr float GraphScale = 2.f;
+static constexpr float GraphHeight = 50.f;
+static constexpr float BudgetMs = 1000.f / 60.f;
+// CPU time allowed to the overlay
+static constexpr double HudBudgetMs = 0.1;
+
+static std::string
+print(const char *format, auto... args)
+{
+	char buffer[128];
+	std::snprintf(buffer, sizeof(buffer), format, args...);
+	return buffer;
+}
+}
+
+Hud::Hud()
+	: mSinceRefresh(RefreshPeriod)
+	, mLines()
+{
+}
+
+void
+Hud::update(const Sample &sample, const FramePacer &pacer)
+{
+	mSinceRefresh += sample.frameTime;
+	if (mSinceRefresh >= RefreshPeriod)
+	{
+		mSinceRefresh = 0.0;
+		format(sample, pacer);
+	}
+}
+
+void
+Hud::format(const Sample &sample, const FramePacer &pacer)
+{
+	auto count = pacer.getFrameCount();
+	std::array<double, FramePacer::History> sorted{};
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		sorted[i] = pacer.getFrameTime(i) * 1000.0;
+	}
+	std::sort(sorted.begin(), sorted.begin() + count);
+	double average = count ? pacer.getStats().average * 1000.0 : 0.0;
+	double p99 = sorted[count * 99 / 100];
+
+	const auto &r = sample.renderer;
+	mLines.clear();
+	mLines.push_back(print("frame %.2f ms  avg %.2f  p99 %.2f",
+	                       sample.frameTime * 1000.0, average, p99));
+	mLines.push_back(print("tick %.3f ms", sample.tickTime * 1000.0));
+	mLines.push_back(print("gpu %.2f ms  scale %.0f%%  aa %s",
+	                       sample.gpuTime * 1000.0, sample.renderScale * 100.f,
+	                       sample.antialiasing.c_str()));
+	mLines.push_back(print("draws %u  vertices %u  upload %.1f KB",
+	                       r.drawCalls, r.vertices, r.bytesUploaded / 1024.0));
+	mLines.push_back(print("batches %u  shaders %u  textures %u",
+	                       r.batches, r.shaderSwitches, r.textureBinds));
+	mLines.push_back(print("particles %u  sources %u",
+	                       sample.particles, sample.audioSources));
+	mLines.push_back(print("glyph atlas %.0f%%", sample.glyphOccupancy * 100.f));
+	mLines.push_back(print("hud %.3f ms%s", sample.hudTime * 1000.0,
+	                       sample.hudTime * 1000.0 > HudBudgetMs ? "  over budget" : ""));
+}
+
+void
+Hud::draw(Renderer &renderer, Font &font, glm::vec2 pos,
+          const FramePacer &pacer) const
+{
+	static const glm::vec3 textColor(1.0f, 1.0f, 0.0f);
+	for (const auto &line : mLines)
+	{
+		renderer.draw(line, pos, font, textColor);
+		pos.y += font.getLineHeight();
+	}
+
+	// frame time graph, oldest frame on the left; the bars over
+	// budget are red
+	pos.y += 4.f;
+	static constexpr auto History = FramePacer::History;
+	renderer.drawRect(pos, glm::vec2(History * 2.f, GraphHeight),
+	                  glm::vec4(0.f, 0.f, 0.f, 0.5f));
+	renderer.drawRect(pos + glm::vec2(0.f, GraphHeight - BudgetMs * GraphScale),
+	                  glm::vec2(History * 2.f, 1.f),
+	                  glm::vec4(1.f, 1.f, 1.f, 0.5f));
+	auto count = pacer.getFrameCount();
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		float ms = pacer.getFrameTime(i) * 1000.0;
+		float height = std::min(ms * GraphScale, GraphHeight);
+		glm::vec4 color = ms > BudgetMs
+			? glm::vec4(1.f, 0.2f, 0.2f, 1.f)
+			: glm::vec4(0.2f, 1.f, 0.2f, 1.f);
+		renderer.drawRect(pos + glm::vec2(i * 2.f, GraphHeight - height),
+		                  glm::vec2(1.f, height), color);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "framepacer.hpp"
+#include "renderer.hpp"
+
+class Font;
+
+// Performance overlay: frame times with their graph, simulation
+// tick time, renderer counters and resource usage. The text is
+// formatted a few times per second, in between only the cached
+// lines and the graph bars are queued. The frame times come from
+// the history of the pacer.
+class Hud
+{
+public:
+	struct Sample
+	{
+		double frameTime;       // seconds
+		double tickTime;        // seconds
+		double gpuTime;         // seconds
+		float renderScale;
+		std::string antialiasing;
+		Renderer::Stats renderer;
+		unsigned particles;
+		unsigned audioSources;
+		float glyphOccupancy;
+		double hudTime;         // seconds, CPU cost of the last draw
+	};
+
+public:
+	Hud();
+
+	void update(const Sample &sample, const FramePacer &pacer);
+	void draw(Renderer &renderer, Font &font, glm::vec2 pos,
+	          const FramePacer &pacer) const;
+
+private:
+	void format(const Sample &sample, const FramePacer &pacer);
+
+	double mSinceRefresh;
+	std::vector<std::string> mLines;
+};
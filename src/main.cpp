@@ -1,18 +1,70 @@
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 #include "game.hpp"
 
+static void
+usage(const char *name)
+{
+	std::cerr << "usage: " << name << " [--headless [--frames N] [--dump DIR]] [--render-scale S]"
+	             " [--aa off|msaa2|msaa4|msaa8|fxaa]\n";
+}
+
+static bool
+parseAntialiasing(const char *name, Postprocess::Antialiasing &mode)
+{
+	using enum Postprocess::Antialiasing;
+	for (auto m : { None, MSAA2, MSAA4, MSAA8, FXAA })
+	{
+		if (std::strcmp(name, Postprocess::getName(m)) == 0)
+		{
+			mode = m;
+			return true;
+		}
+	}
+	return false;
+}
+
 int main(int argc, char *argv[])
 {
-	if (argc != 1)
+	GameOptions options;
+	for (int i = 1; i < argc; ++i)
 	{
-		std::cerr << argv[0] << " takes no arguments.\n";
-		return 1;
+		if (std::strcmp(argv[i], "--headless") == 0)
+		{
+			options.headless = true;
+		}
+		else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			options.frames = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+		{
+			options.dumpPath = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc)
+		{
+			options.renderScale = std::strtof(argv[++i], nullptr);
+		}
+		else if (std::strcmp(argv[i], "--aa") == 0 && i + 1 < argc)
+		{
+			if (!parseAntialiasing(argv[++i], options.antialiasing))
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
 	}
 
 	try
 	{
-		Game game;
+		Game game(options);
 		game.run();
 		return 0;
 	}
@@ -1,7 +1,16 @@
+#include "cpuprofiler.hpp"
 #include "glcheck.hpp"
 #include "particle.hpp"
 
-ParticleGen::ParticleGen(Texture2D texture, unsigned amount)
+ParticleGen::ParticleGen()
+	: mParticles()
+	, mTexture()
+	, mAmount(0)
+	, mLastUsedParticle(0)
+{
+}
+
+ParticleGen::ParticleGen(TextureRegion texture, unsigned amount)
 	: mParticles()
 	, mTexture(texture)
 	, mAmount(amount)
@@ -13,6 +22,7 @@ ParticleGen::ParticleGen(Texture2D texture, unsigned amount)
 void
 ParticleGen::update(float dt, unsigned newParticles, glm::vec2 pos, glm::vec2 vel)
 {
+	PROFILE_ZONE("ParticleGen::update");
 	// new particles
 	while (newParticles-->0)
 	{
@@ -38,7 +48,7 @@ ParticleGen::getParticles() const
 	return mParticles;
 }
 
-const Texture2D &
+const TextureRegion &
 ParticleGen::getTexture() const
 {
 	return mTexture;
@@ -5,7 +5,7 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
-#include "texture.hpp"
+#include "textureatlas.hpp"
 
 struct Particle
 {
@@ -18,12 +18,13 @@ struct Particle
 class ParticleGen
 {
 public:
-	ParticleGen(Texture2D texture, unsigned amount);
+	ParticleGen();
+	ParticleGen(TextureRegion texture, unsigned amount);
 
 	void update(float dt, unsigned newParticles, glm::vec2 pos, glm::vec2 vel);
 
 	const std::vector<Particle> &getParticles() const;
-	const Texture2D &getTexture() const;
+	const TextureRegion &getTexture() const;
 	glm::vec2 getParticleSize() const;
 
 private:
@@ -32,7 +33,7 @@ private:
 	void respawnParticle(Particle &particle, glm::vec2 pos, glm::vec2 vel);
 
 	std::vector<Particle> mParticles;
-	Texture2D mTexture;
+	TextureRegion mTexture;
 	unsigned mAmount;
 	unsigned mLastUsedParticle;
 };
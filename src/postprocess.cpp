@@ -1,56 +1,87 @@
+#include <algorithm>
+#include <cassert>
 #include <iostream>
 
 #include "glcheck.hpp"
+#include "glstate.hpp"
 #include "postprocess.hpp"
 
-Postprocess::Postprocess(unsigned width, unsigned height)
+Postprocess::Postprocess(unsigned width, unsigned height, Antialiasing antialiasing)
 	: Confuse(false)
 	, Chaos(false)
 	, Shake(false)
 	, mTexture()
+	, mPool()
+	, mOutputs()
+	, mLastUse()
 	, mWidth(width)
 	, mHeight(height)
+	, mScale(1.f)
+	, mSceneWidth(width)
+	, mSceneHeight(height)
+	, mAntialiasing(Antialiasing::None)
+	, mSamples(0)
+	, mRBO(0)
 {
 	glCheck(glGenFramebuffers(1, &mMSFBO));
 	glCheck(glGenFramebuffers(1, &mFBO));
-	glCheck(glGenRenderbuffers(1, &mRBO));
-
-	glCheck(glBindFramebuffer(GL_FRAMEBUFFER, mMSFBO));
-	glCheck(glBindRenderbuffer(GL_RENDERBUFFER, mRBO));
-	GLint samples;
-	glGetIntegerv(GL_MAX_SAMPLES, &samples);
-	if (samples > 8)
-	{
-		samples = 8;
-	}
-	glCheck(glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGB, width, height));
-	glCheck(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mRBO));
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-	{
-		throw std::runtime_error("Postprocess(): Failed to initialize MSFBO");
-	}
 
-	glCheck(glBindFramebuffer(GL_FRAMEBUFFER, mFBO));
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, mFBO);
 	mTexture.create(width, height, nullptr, true, true);
 	mTexture.attachToFramebuffer(0);
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 	{
 		throw std::runtime_error("Postprocess: Failed to initialize FBO");
 	}
+
+	setAntialiasing(antialiasing);
 }
 
 Postprocess::~Postprocess()
 {
-	glCheck(glDeleteRenderbuffers(1, &mRBO));
-	glCheck(glDeleteFramebuffers(1, &mFBO));
-	glCheck(glDeleteFramebuffers(1, &mMSFBO));
+	if (mRBO)
+	{
+		glCheck(glDeleteRenderbuffers(1, &mRBO));
+	}
+	GLState::deleteFramebuffer(mFBO);
+	GLState::deleteFramebuffer(mMSFBO);
 	mTexture.destroy();
+	mPool.destroy();
+}
+
+void
+Postprocess::createMultisampleTarget()
+{
+	if (mRBO)
+	{
+		glCheck(glDeleteRenderbuffers(1, &mRBO));
+		mRBO = 0;
+	}
+	if (mSamples == 0)
+	{
+		// the scene is drawn straight into the texture
+		return;
+	}
+
+	glCheck(glGenRenderbuffers(1, &mRBO));
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, mMSFBO);
+	glCheck(glBindRenderbuffer(GL_RENDERBUFFER, mRBO));
+	// same format as the default framebuffer: a multisample
+	// resolve cannot convert
+	glCheck(glRenderbufferStorageMultisample(GL_RENDERBUFFER, mSamples, GL_RGBA8, mWidth, mHeight));
+	glCheck(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mRBO));
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		throw std::runtime_error("Postprocess: Failed to initialize MSFBO");
+	}
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, GLState::getDefaultFramebuffer());
 }
 
 void
 Postprocess::beginRender()
 {
-	glCheck(glBindFramebuffer(GL_FRAMEBUFFER, mMSFBO));
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, mSamples ? mMSFBO : mFBO);
+	glCheck(glViewport(0, 0, mSceneWidth, mSceneHeight));
 	glCheck(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
 	glCheck(glClear(GL_COLOR_BUFFER_BIT));
 }
@@ -58,12 +89,136 @@ Postprocess::beginRender()
 void
 Postprocess::endRender()
 {
-	glCheck(glBindFramebuffer(GL_READ_FRAMEBUFFER, mMSFBO));
-	glCheck(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mFBO));
-	glCheck(glBlitFramebuffer(0, 0, mWidth, mHeight,
-	                          0, 0, mWidth, mHeight,
-	                          GL_COLOR_BUFFER_BIT, GL_NEAREST));
-	glCheck(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+	auto screen = GLState::getDefaultFramebuffer();
+	auto scaled = mSceneWidth != mWidth || mSceneHeight != mHeight;
+	if (mSamples > 0)
+	{
+		GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, mMSFBO);
+		GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER,
+		                         isActive() || scaled ? mFBO : screen);
+		glCheck(glBlitFramebuffer(0, 0, mSceneWidth, mSceneHeight,
+		                          0, 0, mSceneWidth, mSceneHeight,
+		                          GL_COLOR_BUFFER_BIT, GL_NEAREST));
+	}
+	if (!isActive() && (scaled || mSamples == 0))
+	{
+		// the passes are skipped but the scene still needs to
+		// reach the screen; a multisample resolve cannot scale
+		GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, mFBO);
+		GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, screen);
+		glCheck(glBlitFramebuffer(0, 0, mSceneWidth, mSceneHeight,
+		                          0, 0, mWidth, mHeight,
+		                          GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST));
+	}
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, screen);
+	glCheck(glViewport(0, 0, mWidth, mHeight));
+}
+
+void
+Postprocess::setRenderScale(float scale)
+{
+	mScale = std::clamp(scale, 0.f, 1.f);
+	mSceneWidth = std::max(1u, static_cast<unsigned>(mWidth * mScale + 0.5f));
+	mSceneHeight = std::max(1u, static_cast<unsigned>(mHeight * mScale + 0.5f));
+}
+
+float
+Postprocess::getRenderScale() const
+{
+	return mScale;
+}
+
+glm::vec2
+Postprocess::getSceneScale() const
+{
+	return glm::vec2(static_cast<float>(mSceneWidth) / mWidth,
+	                 static_cast<float>(mSceneHeight) / mHeight);
+}
+
+std::vector<std::string>
+Postprocess::getShaderFeatures()
+{
+	// in the order of the effect bits
+	return { "CHAOS", "CONFUSE", "SHAKE", "FXAA" };
+}
+
+unsigned
+Postprocess::reduceEffects(unsigned effects)
+{
+	if (effects & ChaosEffect)
+	{
+		return effects & ~(ConfuseEffect | FxaaEffect);
+	}
+	if ((effects & ShakeEffect) && !(effects & ConfuseEffect))
+	{
+		return effects & ~FxaaEffect;
+	}
+	return effects;
+}
+
+const char *
+Postprocess::getName(Antialiasing mode)
+{
+	switch (mode)
+	{
+	case Antialiasing::None: return "off";
+	case Antialiasing::MSAA2: return "msaa2";
+	case Antialiasing::MSAA4: return "msaa4";
+	case Antialiasing::MSAA8: return "msaa8";
+	case Antialiasing::FXAA: return "fxaa";
+	}
+	return "";
+}
+
+bool
+Postprocess::isActive() const
+{
+	return getEffects() != 0;
+}
+
+unsigned
+Postprocess::getEffects() const
+{
+	return (Chaos ? ChaosEffect : 0)
+		| (Confuse ? ConfuseEffect : 0)
+		| (Shake ? ShakeEffect : 0)
+		| (mAntialiasing == Antialiasing::FXAA ? FxaaEffect : 0);
+}
+
+void
+Postprocess::setAntialiasing(Antialiasing mode)
+{
+	mAntialiasing = mode;
+
+	GLint maxSamples = 0;
+	glCheck(glGetIntegerv(GL_MAX_SAMPLES, &maxSamples));
+	unsigned samples = 0;
+	switch (mode)
+	{
+	case Antialiasing::MSAA2: samples = 2; break;
+	case Antialiasing::MSAA4: samples = 4; break;
+	case Antialiasing::MSAA8: samples = 8; break;
+	default: break;
+	}
+	samples = std::min(samples, static_cast<unsigned>(maxSamples));
+
+	if (samples != mSamples)
+	{
+		mSamples = samples;
+		createMultisampleTarget();
+	}
+}
+
+Postprocess::Antialiasing
+Postprocess::getAntialiasing() const
+{
+	return mAntialiasing;
+}
+
+unsigned
+Postprocess::getSamples() const
+{
+	return mSamples;
 }
 
 void
@@ -71,3 +226,81 @@ Postprocess::bind(int textureUnit) const
 {
 	mTexture.bind(textureUnit);
 }
+
+void
+Postprocess::run(std::span<const Pass> passes,
+                 const std::function<void(const Pass &)> &draw)
+{
+	// the earlier passes cover the part of their target matching
+	// the scene, the last one fills the screen
+	auto sceneScale = getSceneScale();
+
+	// an output goes back to the pool after the last pass reading
+	// it, the passes after can reuse its memory
+	mLastUse.assign(passes.size(), -1);
+	for (int i = 0; i < static_cast<int>(passes.size()); ++i)
+	{
+		for (auto input : passes[i].inputs)
+		{
+			assert(input < i && "a pass reads an earlier output");
+			if (input != Scene)
+			{
+				mLastUse[input] = i;
+			}
+		}
+	}
+
+	mOutputs.assign(passes.size(), nullptr);
+	for (int i = 0; i < static_cast<int>(passes.size()); ++i)
+	{
+		const auto &pass = passes[i];
+		if (i + 1 == static_cast<int>(passes.size()))
+		{
+			GLState::bindFramebuffer(GL_FRAMEBUFFER, GLState::getDefaultFramebuffer());
+			glCheck(glViewport(0, 0, mWidth, mHeight));
+		}
+		else
+		{
+			auto width = std::max(1u, static_cast<unsigned>(mWidth * pass.scale));
+			auto height = std::max(1u, static_cast<unsigned>(mHeight * pass.scale));
+			mOutputs[i] = mPool.acquire(width, height);
+			GLState::bindFramebuffer(GL_FRAMEBUFFER, mOutputs[i]->fbo);
+			auto covered = glm::max(glm::round(glm::vec2(width, height) * sceneScale),
+			                        glm::vec2(1.f));
+			glCheck(glViewport(0, 0, static_cast<GLsizei>(covered.x),
+			                   static_cast<GLsizei>(covered.y)));
+		}
+
+		int unit = 0;
+		for (auto input : pass.inputs)
+		{
+			if (input == Scene)
+			{
+				mTexture.bind(unit++);
+			}
+			else
+			{
+				mOutputs[input]->texture.bind(unit++);
+			}
+		}
+
+		draw(pass);
+
+		for (auto input : pass.inputs)
+		{
+			if (input != Scene && mLastUse[input] == i)
+			{
+				mPool.release(mOutputs[input]);
+			}
+		}
+	}
+
+	// outputs nobody reads
+	for (std::size_t i = 0; i + 1 < passes.size(); ++i)
+	{
+		if (mLastUse[i] == -1)
+		{
+			mPool.release(mOutputs[i]);
+		}
+	}
+}
@@ -1,32 +1,112 @@
 #pragma once
 
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "rendertargetpool.hpp"
 #include "texture.hpp"
 #include "shader.hpp"
 
 class Postprocess
 {
 public:
-	Postprocess(unsigned width, unsigned height);
+	// bits of the active effects, they select the variant of the
+	// postprocess shader compiled with the matching features
+	static constexpr unsigned ChaosEffect = 1 << 0;
+	static constexpr unsigned ConfuseEffect = 1 << 1;
+	static constexpr unsigned ShakeEffect = 1 << 2;
+	static constexpr unsigned FxaaEffect = 1 << 3;
+
+	static std::vector<std::string> getShaderFeatures();
+	// the mask of effects compiling to the same shader: CHAOS hides
+	// CONFUSE and FXAA, the blurred SHAKE alone skips FXAA
+	static unsigned reduceEffects(unsigned effects);
+
+	// FXAA is folded into the postprocess shader: it keeps the pass
+	// running without effects
+	enum class Antialiasing
+	{
+		None,
+		MSAA2,
+		MSAA4,
+		MSAA8,
+		FXAA,
+	};
+
+	static const char *getName(Antialiasing mode);
+
+	// input of a pass reading the resolved scene
+	static constexpr int Scene = -1;
+
+	// A pass of the chain draws a full screen quad with its inputs
+	// bound to the texture units in order. The inputs are the
+	// resolved scene or the outputs of earlier passes, the last
+	// pass writes the default framebuffer.
+	struct Pass
+	{
+		const Shader *shader;
+		std::vector<int> inputs;
+		// size of the output relative to the screen
+		float scale;
+	};
+
+public:
+	Postprocess(unsigned width, unsigned height, Antialiasing antialiasing);
 	~Postprocess();
 
 	void beginRender();
 	void endRender();
 	void bind(int textureUnit) const;
 
+	// run the passes, draw is called with the output and the inputs
+	// of the pass bound
+	void run(std::span<const Pass> passes,
+	         const std::function<void(const Pass &)> &draw);
+
+	// without effects the scene is resolved straight into the
+	// default framebuffer and the postprocess pass is skipped
+	bool isActive() const;
+	unsigned getEffects() const;
+
+	// the scene is drawn in a corner of the targets, scaled down
+	// from the screen, and the last pass upscales it
+	void setRenderScale(float scale);
+	float getRenderScale() const;
+	// part of the targets covered by the scene
+	glm::vec2 getSceneScale() const;
+
+	// the multisampled target is rebuilt when the samples change,
+	// they are limited by GL_MAX_SAMPLES
+	void setAntialiasing(Antialiasing mode);
+	Antialiasing getAntialiasing() const;
+	unsigned getSamples() const;
+
 	bool Confuse;
 	bool Chaos;
 	bool Shake;
 
 private:
+	void createMultisampleTarget();
+
 	Texture2D mTexture;
+	RenderTargetPool mPool;
+	std::vector<RenderTarget *> mOutputs;
+	std::vector<int> mLastUse;
 
 	unsigned mWidth;
 	unsigned mHeight;
+	float mScale;
+	unsigned mSceneWidth;
+	unsigned mSceneHeight;
+	Antialiasing mAntialiasing;
+	unsigned mSamples;
 
 	GLuint mMSFBO;          // multisampled FBO
 	GLuint mFBO;            // regular FBO
-	GLuint mRBO;            // render buffer
+	GLuint mRBO;            // render buffer, 0 without samples
 };
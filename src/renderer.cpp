@@ -1,9 +1,15 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <iostream>
+#include <type_traits>
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "cpuprofiler.hpp"
 #include "font.hpp"
 #include "glcheck.hpp"
+#include "glstate.hpp"
 #include "particle.hpp"
 #include "postprocess.hpp"
 #include "utility.hpp"
@@ -13,6 +19,35 @@
 namespace
 {
 static const std::uint16_t indices[] = { 0, 1, 2, 1, 3, 2 };
+
+// the index buffer is shared by all the quads and it's limited by
+// the range of the 16-bit indices
+static constexpr unsigned MaxBatchQuads = (UINT16_MAX + 1) / 4;
+
+// binding point of the Frame uniform block
+static constexpr GLuint FrameBinding = 0;
+
+// initial size of each of the segments of the vertex stream
+static constexpr std::size_t StreamSegmentSize = 1 << 20;
+
+// frames a cached string survives without being drawn
+static constexpr unsigned TextRunLifetime = 120;
+
+// levels with more blocks are drawn as a tilemap in LevelMode::Auto
+static constexpr std::size_t TilemapThreshold = 4096;
+
+// layout of the blocks atlas
+static constexpr float BlockTileWidth = 128.f / 1024.f;
+static constexpr glm::vec2 BlockUVSize = { BlockTileWidth, 1.f };
+static constexpr glm::vec2 BlockUVPos[] = {
+	{0 * BlockTileWidth, 0.f},
+	{1 * BlockTileWidth, 0.f},
+	{2 * BlockTileWidth, 0.f},
+	{3 * BlockTileWidth, 0.f},
+	{4 * BlockTileWidth, 0.f},
+	{5 * BlockTileWidth, 0.f},
+};
+
 static const glm::vec2 units[] = {
 	{ 0.f, 0.f },
 	{ 0.f, 1.f },
@@ -37,85 +72,237 @@ static const float offsets[][2] = {
 	{    0.0f, -offset },
 	{  offset, -offset },
 };
+
 static const GLint edge_kernel[9] = {
 	-1, -1, -1,
 	-1,  8, -1,
 	-1, -1, -1,
 };
-static const float blur_kernel[9] = {
-	1.f / 16.f, 2.f / 16.f, 1.f / 16.f,
-	2.f / 16.f, 4.f / 16.f, 2.f / 16.f,
-	1.f / 16.f, 2.f / 16.f, 1.f / 16.f,
+
+// the shake blur runs at half resolution, its standard deviation
+// is a fraction of the height of the scene so the look does not
+// depend on the size of the window or on the render scale
+static constexpr float BlurScale = 0.5f;
+static constexpr float BlurSigma = 1.f / 300.f;
+// MAX_TAPS in blur.fs
+static constexpr int MaxBlurTaps = 16;
+
+// one direction of a gaussian blur: past the center each tap
+// samples between two texels and the bilinear filter blends them
+// with their weights, halving the number of fetches
+struct BlurKernel
+{
+	int taps;
+	float offsets[MaxBlurTaps];
+	float weights[MaxBlurTaps];
 };
+
+static BlurKernel
+makeBlurKernel(float sigma)
+{
+	sigma = std::max(sigma, 0.5f);
+	auto radius = std::min(static_cast<int>(std::ceil(3.f * sigma)),
+	                       2 * (MaxBlurTaps - 1));
+
+	std::vector<float> texels(radius + 1);
+	float sum = 0.f;
+	for (int i = 0; i <= radius; ++i)
+	{
+		texels[i] = std::exp(-static_cast<float>(i * i) / (2.f * sigma * sigma));
+		sum += i ? 2.f * texels[i] : texels[i];
+	}
+
+	BlurKernel kernel{};
+	kernel.offsets[0] = 0.f;
+	kernel.weights[0] = texels[0] / sum;
+	kernel.taps = 1;
+	for (int i = 1; i <= radius; i += 2)
+	{
+		auto a = texels[i];
+		auto b = i < radius ? texels[i + 1] : 0.f;
+		kernel.offsets[kernel.taps] = (i * a + (i + 1) * b) / (a + b);
+		kernel.weights[kernel.taps] = (a + b) / sum;
+		kernel.taps++;
+	}
+	return kernel;
+}
 }
 
-Renderer::Renderer(unsigned screenWidth, unsigned screenHeight, const ShaderHolder &shaders)
-	: mVertexOffset(0)
-	, mVertexCount(0)
-	, mIndexOffset(0)
-	, mIndexCount(0)
-	, mPostShader(shaders.get(ShaderID::Postprocess))
-	, mTextureShader(shaders.get(ShaderID::Texture))
-	, mUniformColorShader(shaders.get(ShaderID::UniformColor))
+Renderer::Renderer(unsigned screenWidth, unsigned screenHeight,
+                   unsigned framebufferWidth, unsigned framebufferHeight,
+                   const ShaderHolder &shaders, const ShaderVariants &postShaders,
+                   const ShaderVariants &blurShaders)
+	: mLevelMode(LevelMode::Auto)
+	, mWhite()
+	, mStats()
+	, mStateBaseline()
+	, mStatsHistory()
+	, mFrameCount(0)
+	, mPostShaders(postShaders)
+	, mBlurShaders(blurShaders)
+	, mTilemapShader(shaders.get(ShaderID::Tilemap))
 	, mVertexColorShader(shaders.get(ShaderID::VertexColor))
+	, mPostUniforms()
+	, mBlurUniforms()
+	, mPostChains()
+	, mBlurHeight(1)
+	, mBlurSceneScale(0.f)
+	, mTilemapUniforms{
+		mTilemapShader.getUniform("image"),
+		mTilemapShader.getUniform("tiles"),
+		mTilemapShader.getUniform("tileRect"),
+	}
+	, mSpriteUniforms{
+		mVertexColorShader.getUniform("image"),
+	}
+	, mFrame()
+	, mFrameUBO(0)
+	, mVertexStream(GL_ARRAY_BUFFER, StreamSegmentSize)
+	, mStreamVBO(0)
 {
-	// bind a buffer to allow calling glVertexAttribPointer()
-	glCheck(glGenBuffers(1, &mVBO));
-	glCheck(glBindBuffer(GL_ARRAY_BUFFER, mVBO));
+	// the quad indices never change: upload them once
+	std::vector<std::uint16_t> quadIndices;
+	quadIndices.reserve(MaxBatchQuads * std::size(indices));
+	for (unsigned q = 0; q < MaxBatchQuads; ++q)
+	{
+		for (auto i : indices)
+		{
+			quadIndices.push_back(q * 4 + i);
+		}
+	}
+
+	glCheck(glGenVertexArrays(1, &mVAO));
+	GLState::bindVertexArray(mVAO);
 
 	glCheck(glGenBuffers(1, &mEBO));
-	glCheck(glGenVertexArrays(1, &mSimpleVAO));
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+	glCheck(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+	                     quadIndices.size() * sizeof(quadIndices[0]),
+	                     quadIndices.data(),
+	                     GL_STATIC_DRAW));
+
+	bindVertexStream();
 
-	// for mSimpleVAO we have only one packed attrib pointer
-	glCheck(glBindVertexArray(mSimpleVAO));
+	// the full screen quad of the postprocess pass is static
+	glCheck(glGenVertexArrays(1, &mQuadVAO));
+	GLState::bindVertexArray(mQuadVAO);
+	glCheck(glGenBuffers(1, &mQuadVBO));
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mQuadVBO);
+	glCheck(glBufferData(GL_ARRAY_BUFFER, sizeof(fullquad), fullquad,
+	                     GL_STATIC_DRAW));
 	glCheck(glEnableVertexAttribArray(0));
 	glCheck(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0));
 
-	// for mColorVAO we have two attrib pointers
-	glCheck(glGenVertexArrays(1, &mColorVAO));
-	glCheck(glBindVertexArray(mColorVAO));
-	glCheck(glEnableVertexAttribArray(0));
-	glCheck(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE,
-	                              sizeof(ColorVertex),
-	                              reinterpret_cast<GLvoid*>(offsetof(ColorVertex, pos))));
-	glCheck(glEnableVertexAttribArray(1));
-	glCheck(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE,
-	                              sizeof(ColorVertex),
-	                              reinterpret_cast<GLvoid*>(offsetof(ColorVertex, color))));
+	static_assert(sizeof(FrameUniforms) == 80, "FrameUniforms must match std140");
+	static_assert(offsetof(FrameUniforms, sceneScale) == 72, "FrameUniforms must match std140");
 
 	// create the orthographic projection matrix
-	glm::mat4 proj = glm::ortho(
+	mFrame.projection = glm::ortho(
 		0.0f, static_cast<GLfloat>(screenWidth),
 		static_cast<GLfloat>(screenHeight), 0.0f,
 		-1.0f, 1.0f);
+	mFrame.sceneScale = glm::vec2(1.f);
+
+	// the data shared by the programs lives in a uniform buffer
+	glCheck(glGenBuffers(1, &mFrameUBO));
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, mFrameUBO);
+	glCheck(glBufferData(GL_UNIFORM_BUFFER, sizeof(mFrame), &mFrame,
+	                     GL_DYNAMIC_DRAW));
+	glCheck(glBindBufferBase(GL_UNIFORM_BUFFER, FrameBinding, mFrameUBO));
+	for (const auto *shader : { &mTilemapShader, &mVertexColorShader })
+	{
+		shader->bindUniformBlock("Frame", FrameBinding);
+	}
 
-	// configure the shaders
-	mPostShader.use();
-	mPostShader.getUniform("scene").setInteger(0);
-	mPostShader.getUniform("offsets").setVector2fv(offsets, 9);
-	mPostShader.getUniform("edge_kernel").setInteger1iv(edge_kernel, 9);
-	mPostShader.getUniform("blur_kernel").setFloat1fv(blur_kernel, 9);
+	// the two directions of the shake blur, the kernel follows the
+	// render scale
+	mBlurHeight = std::max(1u, static_cast<unsigned>(framebufferHeight * BlurScale));
+	for (unsigned i = 0; i < mBlurShaders.size(); ++i)
+	{
+		const auto &shader = mBlurShaders.get(i);
+		shader.bindUniformBlock("Frame", FrameBinding);
+		const auto &uniforms = mBlurUniforms.emplace_back(BlurUniforms{
+			shader.getUniform("image"),
+			shader.getUniform("taps"),
+			shader.getUniform("offsets"),
+			shader.getUniform("weights"),
+		});
+		shader.use();
+		uniforms.image.setInteger(0);
+	}
+	setBlurKernel(1.f);
+	const auto &blurX = mBlurShaders.get(0);
+	const auto &blurY = mBlurShaders.get(1);
 
-	mTextureShader.use();
-	mTextureShader.getUniform("image").setInteger(0);
-	mTextureShader.getUniform("projection").setMatrix4(proj);
+	// configure the shaders, the postprocess variants only have
+	// the uniforms of their effects
+	for (unsigned i = 0; i < mPostShaders.size(); ++i)
+	{
+		const auto &shader = mPostShaders.get(i);
+		if (shader.hasUniformBlock("Frame"))
+		{
+			shader.bindUniformBlock("Frame", FrameBinding);
+		}
+		const auto &uniforms = mPostUniforms.emplace_back(PostUniforms{
+			shader.getUniform("scene"),
+			shader.findUniform("offsets"),
+			shader.findUniform("edge_kernel"),
+		});
+		shader.use();
+		uniforms.scene.setInteger(0);
+		uniforms.offsets.setVector2fv(offsets, 9);
+		uniforms.edgeKernel.setInteger1iv(edge_kernel, 9);
+
+		// the shake alone blurs the scene in two passes at reduced
+		// resolution, the last pass upscales it; the copy without
+		// effects downsamples the scene first so that the taps of
+		// both passes fall on the texels the kernel was made for
+		if ((i & ~Postprocess::FxaaEffect) == Postprocess::ShakeEffect)
+		{
+			mPostChains.push_back({
+				{ &mPostShaders.get(0), { Postprocess::Scene }, BlurScale },
+				{ &blurX, { 0 }, BlurScale },
+				{ &blurY, { 1 }, BlurScale },
+				{ &shader, { 2 }, 1.f },
+			});
+		}
+		else
+		{
+			mPostChains.push_back({
+				{ &shader, { Postprocess::Scene }, 1.f },
+			});
+		}
+	}
 
-	mUniformColorShader.use();
-	mUniformColorShader.getUniform("image").setInteger(0);
-	mUniformColorShader.getUniform("projection").setMatrix4(proj);
+	mTilemapShader.use();
+	mTilemapUniforms.image.setInteger(0);
+	mTilemapUniforms.tiles.setInteger(1);
 
 	mVertexColorShader.use();
-	mVertexColorShader.getUniform("image").setInteger(0);
-	mVertexColorShader.getUniform("projection").setMatrix4(proj);
+	mSpriteUniforms.image.setInteger(0);
+
+	// texture of the untextured rectangles
+	static const std::uint8_t white[] = { 255, 255, 255, 255 };
+	mWhite.create(1, 1, white, false, false);
 }
 
 Renderer::~Renderer()
 {
-	glCheck(glBindVertexArray(0));
-	glCheck(glDeleteVertexArrays(1, &mColorVAO));
-	glCheck(glDeleteVertexArrays(1, &mSimpleVAO));
-	glCheck(glDeleteBuffers(1, &mEBO));
-	glCheck(glDeleteBuffers(1, &mVBO));
+	GLState::bindVertexArray(0);
+	for (auto &[_, mesh] : mLevelMeshes)
+	{
+		destroyMesh(mesh);
+	}
+	for (auto &[_, tiles] : mLevelTilemaps)
+	{
+		tiles.destroy();
+	}
+	GLState::deleteVertexArray(mQuadVAO);
+	GLState::deleteVertexArray(mVAO);
+	GLState::deleteBuffer(mQuadVBO);
+	GLState::deleteBuffer(mEBO);
+	GLState::deleteBuffer(mFrameUBO);
+	mWhite.destroy();
 }
 
 void
@@ -128,264 +315,628 @@ Renderer::clear(glm::vec4 color) const
 void
 Renderer::draw(const std::string &text, glm::vec2 pos, Font &font, glm::vec3 color)
 {
+	PROFILE_ZONE("Renderer::draw(text)");
+	if (text.empty())
+	{
+		return;
+	}
+	draw(getTextRun(mTextRuns[&font].utf8, std::string_view(text), font), pos, font, color);
+}
+
+void
+Renderer::draw(std::u32string_view text, glm::vec2 pos, Font &font, glm::vec3 color)
+{
+	PROFILE_ZONE("Renderer::draw(text)");
 	if (text.empty())
 	{
 		return;
 	}
+	draw(getTextRun(mTextRuns[&font].utf32, text, font), pos, font, color);
+}
 
-	// ensure the needed glyphs are rendered
-	auto codepoints = Utility::decodeUTF8(text);
-	for (auto codepoint: codepoints)
+void
+Renderer::draw(const TextRun &run, glm::vec2 pos, Font &font, glm::vec3 color)
+{
+	auto texture = font.getTexture();
+	for (auto quad : run.quads)
 	{
-		font.getGlyph(codepoint);
+		quad.pos += pos;
+		quad.color = glm::vec4(color, 1.f);
+		push(Layer::Text, mVertexColorShader, texture, Blend::Alpha, quad);
 	}
+}
 
-	mUniformColorShader.use();
-	mUniformColorShader.getUniform("uniformColor").setVector3f(color);
-	font.getTexture().bind(0);
+std::size_t
+Renderer::TextHash::operator()(std::string_view text) const noexcept
+{
+	return std::hash<std::string_view>()(text);
+}
 
-	mSimpleVertices.clear();
-	beginBatch();
-	pos.y += font.getLineHeight();
-	for (auto codepoint : codepoints)
+std::size_t
+Renderer::TextHash::operator()(std::u32string_view text) const noexcept
+{
+	return std::hash<std::u32string_view>()(text);
+}
+
+template <typename Runs, typename Text>
+const Renderer::TextRun &
+Renderer::getTextRun(Runs &runs, Text text, Font &font)
+{
+	auto found = runs.find(text);
+	if (found == runs.end())
+	{
+		// with a version the atlas doesn't have, to build it below
+		found = runs.emplace(typename Runs::key_type(text),
+		                     TextRun{{}, font.getAtlasVersion() - 1, 0}).first;
+	}
+	auto &run = found->second;
+	run.lastFrame = mFrameCount;
+	if (run.atlasVersion == font.getAtlasVersion())
+	{
+		return run;
+	}
+
+	// a glyph rendered on the way can grow the atlas and move the
+	// earlier ones: the run is built again until it is stable
+	std::u32string decoded;
+	std::u32string_view codepoints;
+	if constexpr (std::is_same_v<Text, std::string_view>)
 	{
-		const auto &g = font.getGlyph(codepoint);
-		pos.x += g.bearing.x;
-		pos.y -= g.bearing.y;
-		reserve(4, indices);
-		for (auto unit : units)
+		decoded = Utility::decodeUTF8(text);
+		codepoints = decoded;
+	}
+	else
+	{
+		codepoints = text;
+	}
+	while (run.atlasVersion != font.getAtlasVersion())
+	{
+		run.atlasVersion = font.getAtlasVersion();
+		run.quads.clear();
+		glm::vec2 pos(0.f, font.getLineHeight());
+		for (auto codepoint : codepoints)
 		{
-			SimpleVertex v;
-			v.pos = g.size * unit + pos;
-			v.uv = g.uvSize * unit + g.uvPos;
-			mSimpleVertices.push_back(v);
+			const auto &g = font.getGlyph(codepoint);
+			run.quads.push_back({ pos + glm::vec2(g.bearing.x, -g.bearing.y), g.size,
+			                      g.uvPos, g.uvSize, glm::vec4(1.f) });
+			pos.x += g.advance;
 		}
-		pos.x += g.advance - g.bearing.x;
-		pos.y += g.bearing.y;
 	}
-	endBatch();
+	return run;
+}
 
-	glCheck(glBindVertexArray(mSimpleVAO));
-	glCheck(glBindBuffer(GL_ARRAY_BUFFER, mVBO));
-	glCheck(glBufferData(GL_ARRAY_BUFFER,
-	                     mSimpleVertices.size() * sizeof(mSimpleVertices[0]),
-	                     mSimpleVertices.data(),
-	                     GL_STREAM_DRAW));
-	drawBuffers();
+void
+Renderer::draw(Level &level)
+{
+	PROFILE_ZONE("Renderer::draw(Level)");
+	// apply the changes to the cached representations
+	if (!level.dirty.empty())
+	{
+		auto &dirty = level.dirty;
+		std::sort(dirty.begin(), dirty.end());
+		dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+		// patch the ranges of adjacent changed blocks
+		auto mesh = mLevelMeshes.find(&level);
+		if (mesh != mLevelMeshes.end() && mesh->second.quads == level.blocks.size())
+		{
+			for (auto i = dirty.begin(), end = dirty.end(); i != end; )
+			{
+				auto first = *i;
+				mMeshSprites.clear();
+				do
+				{
+					mMeshSprites.push_back(getBlockSprite(level, level.blocks[*i]));
+					++i;
+				}
+				while (i != end && *i == first + mMeshSprites.size());
+				updateMesh(mesh->second, first, mMeshSprites);
+			}
+		}
+
+		// a block is a single texel of the tilemap, the changed
+		// blocks on adjacent cells of a row share an upload
+		auto tilemap = mLevelTilemaps.find(&level);
+		if (tilemap != mLevelTilemaps.end())
+		{
+			for (auto i = dirty.begin(), end = dirty.end(); i != end; )
+			{
+				auto first = level.blocks[*i].cell;
+				mTiles.clear();
+				do
+				{
+					const auto &b = level.blocks[*i];
+					mTiles.push_back(b.dead ? 0 : b.type);
+					++i;
+				}
+				while (i != end
+				       && level.blocks[*i].cell
+				          == glm::uvec2(first.x + mTiles.size(), first.y));
+				tilemap->second.update(mTiles.data(), first.x, first.y, mTiles.size(), 1);
+				mStats.bytesUploaded += mTiles.size();
+			}
+		}
+		dirty.clear();
+	}
+
+	bool useTilemap = mLevelMode == LevelMode::Tilemap
+		|| (mLevelMode == LevelMode::Auto
+		    && level.blocks.size() > TilemapThreshold);
+	if (useTilemap)
+	{
+		drawLevelTilemap(level);
+	}
+	else
+	{
+		drawLevelMesh(level);
+	}
 }
 
 void
-Renderer::draw(const Level &level)
-{
-	static constexpr glm::vec2 uvSize = { 128.f/1024.f, 1.f };
-	static constexpr glm::vec2 uvPos[] = {
-		{0 * 128.f/1024.f, 0.f},
-		{1 * 128.f/1024.f, 0.f},
-		{2 * 128.f/1024.f, 0.f},
-		{3 * 128.f/1024.f, 0.f},
-		{4 * 128.f/1024.f, 0.f},
-		{5 * 128.f/1024.f, 0.f},
-	};
-
-	mSimpleVertices.clear();
-	beginBatch();
-	glm::vec2 blockSize = level.blockSize;
-	for (const auto &b : level.blocks)
-	{
-		if (b.dead)
+Renderer::drawLevelMesh(const Level &level)
+{
+	auto [it, created] = mLevelMeshes.try_emplace(&level);
+	auto &mesh = it->second;
+	if (created || mesh.quads != level.blocks.size())
+	{
+		mMeshSprites.clear();
+		for (const auto &b : level.blocks)
 		{
-			continue;
+			mMeshSprites.push_back(getBlockSprite(level, b));
 		}
-		reserve(4, indices);
-		for (auto unit : units)
+		createMesh(mesh, mMeshSprites);
+	}
+	push(Layer::Level, mVertexColorShader, level.texture.texture, Blend::Alpha, mesh);
+}
+
+void
+Renderer::drawLevelTilemap(const Level &level)
+{
+	auto [it, created] = mLevelTilemaps.try_emplace(&level);
+	auto &tiles = it->second;
+	if (created)
+	{
+		mTiles.assign(level.columns * level.rows, 0);
+		for (const auto &b : level.blocks)
 		{
-			SimpleVertex v;
-			v.pos = blockSize * unit + b.position;
-			v.uv = uvSize * unit + uvPos[b.type];
-			mSimpleVertices.push_back(v);
+			if (!b.dead)
+			{
+				mTiles[b.cell.y * level.columns + b.cell.x] = b.type;
+			}
 		}
+		tiles.create(level.columns, level.rows, mTiles.data(),
+		             false, false, Texture2D::Format::Red);
+		mStats.bytesUploaded += mTiles.size();
 	}
-	endBatch();
 
-	glCheck(glBindVertexArray(mSimpleVAO));
-	glCheck(glBindBuffer(GL_ARRAY_BUFFER, mVBO));
-	glCheck(glBufferData(GL_ARRAY_BUFFER,
-	                     mSimpleVertices.size() * sizeof(mSimpleVertices[0]),
-	                     mSimpleVertices.data(),
-	                     GL_STREAM_DRAW));
+	// the whole level is a quad whose uv are the tile coordinates,
+	// the shader maps them to the blocks region of the atlas
+	const auto &region = level.texture;
+	glm::vec2 grid(level.columns, level.rows);
+	push(Layer::Level, mTilemapShader, region.texture, Blend::Alpha,
+	     { level.origin, level.blockSize * grid, glm::vec2(0.f), grid, glm::vec4(1.f) },
+	     tiles);
+	// the lookup texture is in the key, the command holds this
+	// level only
+	mCommands.back().tileRect = glm::vec4(
+		region.uvPos.x, region.uvPos.y,
+		region.uvSize.x * BlockTileWidth, region.uvSize.y);
+}
 
-	mTextureShader.use();
-	level.texture.bind(0);
-	drawBuffers();
+Renderer::Sprite
+Renderer::getBlockSprite(const Level &level, const Block &b)
+{
+	// dead blocks are kept in the mesh as degenerate quads
+	const auto &region = level.texture;
+	glm::vec2 size = b.dead ? glm::vec2(0.f) : level.blockSize;
+	return { b.position, size,
+	         region.uvPos + BlockUVPos[b.type] * region.uvSize,
+	         BlockUVSize * region.uvSize,
+	         glm::vec4(1.f) };
+}
+
+void
+Renderer::setLevelMode(LevelMode mode)
+{
+	mLevelMode = mode;
 }
 
 void
 Renderer::draw(const ParticleGen &pg)
 {
-	mColorVertices.clear();
+	PROFILE_ZONE("Renderer::draw(ParticleGen)");
 	auto size = pg.getParticleSize();
-	beginBatch();
+	const auto &texture = pg.getTexture();
 	for (const auto &p : pg.getParticles())
 	{
 		if (p.life <= 0.f)
 		{
 			continue;
 		}
-		reserve(4, indices);
-		for (auto unit : units)
-		{
-			ColorVertex v;
-			v.pos = size * unit + p.position;
-			v.uv = unit;
-			v.color = p.color;
-			mColorVertices.push_back(v);
-		}
+		// additive blending for the glow effect
+		push(Layer::Particles, mVertexColorShader, texture.texture, Blend::Additive,
+		     { p.position, size, texture.uvPos, texture.uvSize, p.color });
 	}
-	endBatch();
-
-	glCheck(glBindVertexArray(mColorVAO));
-	glCheck(glBindBuffer(GL_ARRAY_BUFFER, mVBO));
-	glCheck(glBufferData(GL_ARRAY_BUFFER,
-	                     mColorVertices.size() * sizeof(mColorVertices[0]),
-	                     mColorVertices.data(),
-	                     GL_STREAM_DRAW));
-	mVertexColorShader.use();
-	pg.getTexture().bind(0);
-
-	// set an additive blending for the glow effect
-	glCheck(glBlendFunc(GL_SRC_ALPHA, GL_ONE));
-
-	drawBuffers();
-
-	// restore the previous blend function
-	glCheck(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
 }
 
 void
-Renderer::draw(const Postprocess &pp, float time)
+Renderer::draw(Postprocess &pp, float time)
 {
-	beginBatch();
-	reserve(4, indices);
-	endBatch();
-
-	glCheck(glBindVertexArray(mSimpleVAO));
-	glCheck(glBindBuffer(GL_ARRAY_BUFFER, mVBO));
-	glCheck(glBufferData(GL_ARRAY_BUFFER, sizeof(fullquad), fullquad,
-	                     GL_STREAM_DRAW));
+	PROFILE_ZONE("Renderer::draw(Postprocess)");
+	// the postprocess pass reads what has been queued until now
+	flush();
+	if (!pp.isActive())
+	{
+		return;
+	}
 
-	mPostShader.use();
-	mPostShader.getUniform("time").setFloat(time);
-	mPostShader.getUniform("confuse").setInteger(pp.Confuse);
-	mPostShader.getUniform("chaos").setInteger(pp.Chaos);
-	mPostShader.getUniform("shake").setInteger(pp.Shake);
-	pp.bind(0);
-	drawBuffers();
+	// update the per frame part of the uniform block
+	mFrame.time = time;
+	mFrame.sceneScale = pp.getSceneScale();
+	if (mFrame.sceneScale.y != mBlurSceneScale)
+	{
+		setBlurKernel(mFrame.sceneScale.y);
+	}
+	static constexpr auto PerFrameSize = sizeof(FrameUniforms) - offsetof(FrameUniforms, time);
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, mFrameUBO);
+	glCheck(glBufferSubData(GL_UNIFORM_BUFFER,
+	                        offsetof(FrameUniforms, time),
+	                        PerFrameSize,
+	                        &mFrame.time));
+	mStats.bytesUploaded += PerFrameSize;
+
+	// the passes use the variants of the shader with the active
+	// effects only
+	GLState::bindVertexArray(mQuadVAO);
+	pp.run(mPostChains[pp.getEffects()], [&](const Postprocess::Pass &pass) {
+		pass.shader->use();
+		glCheck(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+		mStats.drawCalls++;
+		mStats.vertices += 4;
+	});
 }
 
 void
-Renderer::draw(Texture2D texture, glm::vec2 position, glm::vec2 size, glm::vec3 color)
+Renderer::setBlurKernel(float sceneScale)
 {
-	mSimpleVertices.clear();
-	beginBatch();
-	reserve(4, indices);
-	for (auto unit : units)
+	// the scene covers fewer texels of the targets at lower scales
+	auto kernel = makeBlurKernel(BlurSigma * mBlurHeight * sceneScale);
+	for (unsigned i = 0; i < mBlurShaders.size(); ++i)
 	{
-		SimpleVertex v;
-		v.pos = size * unit + position;
-		v.uv = unit;
-		mSimpleVertices.push_back(v);
+		const auto &uniforms = mBlurUniforms[i];
+		mBlurShaders.get(i).use();
+		uniforms.taps.setInteger(kernel.taps);
+		uniforms.offsets.setFloat1fv(kernel.offsets, kernel.taps);
+		uniforms.weights.setFloat1fv(kernel.weights, kernel.taps);
 	}
-	endBatch();
+	mBlurSceneScale = sceneScale;
+}
 
-	glCheck(glBindVertexArray(mSimpleVAO));
-	glCheck(glBindBuffer(GL_ARRAY_BUFFER, mVBO));
-	glCheck(glBufferData(GL_ARRAY_BUFFER,
-	                     mSimpleVertices.size()*sizeof(mSimpleVertices[0]),
-	                     mSimpleVertices.data(),
-	                     GL_STREAM_DRAW));
-	mUniformColorShader.use();
-	mUniformColorShader.getUniform("uniformColor").setVector3f(color);
+void
+Renderer::draw(const TextureRegion &texture, glm::vec2 position, glm::vec2 size,
+               glm::vec3 color, Layer layer)
+{
+	PROFILE_ZONE("Renderer::draw(TextureRegion)");
+	push(layer, mVertexColorShader, texture.texture, Blend::Alpha,
+	     { position, size, texture.uvPos, texture.uvSize, glm::vec4(color, 1.f) });
+}
 
-	texture.bind(0);
-	drawBuffers();
+void
+Renderer::drawRect(glm::vec2 pos, glm::vec2 size, glm::vec4 color, Layer layer)
+{
+	push(layer, mVertexColorShader, mWhite, Blend::Alpha,
+	     { pos, size, glm::vec2(0.f), glm::vec2(1.f), color });
 }
 
 void
 Renderer::draw(const Paddle &paddle)
 {
+	PROFILE_ZONE("Renderer::draw(Paddle)");
 	draw(paddle.texture, paddle.pos, paddle.size, paddle.color);
 }
 void
 Renderer::draw(const Ball &ball)
 {
-	draw(ball.texture, ball.pos, ball.size, ball.color);
+	PROFILE_ZONE("Renderer::draw(Ball)");
+	draw(ball.texture, ball.pos, ball.size, ball.color, Layer::Ball);
 }
 
 void
 Renderer::draw(const PowerUP &pow)
 {
+	PROFILE_ZONE("Renderer::draw(PowerUP)");
 	draw(pow.texture, pow.pos, pow.size, pow.color);
 }
 
 void
-Renderer::saveBatch()
+Renderer::push(Layer layer, const Shader &shader, Texture2D texture,
+               Blend blend, const Sprite &sprite, Texture2D lookup)
+{
+	SortKey key{ layer, shader.getHandle(), texture.getHandle(),
+	             lookup.getHandle(), blend, mVAO };
+	unsigned index = mSprites.size();
+	mSprites.push_back(sprite);
+
+	// extend the last command if the state didn't change
+	if (!mCommands.empty())
+	{
+		auto &last = mCommands.back();
+		if (last.key == key && last.first + last.count == index)
+		{
+			last.count++;
+			return;
+		}
+	}
+	mCommands.emplace_back(key, &shader, texture, lookup, index, 1, glm::vec4(0.f));
+}
+
+void
+Renderer::push(Layer layer, const Shader &shader, Texture2D texture,
+               Blend blend, const Mesh &mesh)
+{
+	Texture2D lookup;
+	SortKey key{ layer, shader.getHandle(), texture.getHandle(),
+	             lookup.getHandle(), blend, mesh.vao };
+	mCommands.emplace_back(key, &shader, texture, lookup, 0, mesh.quads, glm::vec4(0.f));
+}
+
+Renderer::Vertex *
+Renderer::writeQuad(Vertex *v, const Sprite &s)
 {
-	mBatches.emplace_back(mVertexOffset, mIndexOffset*sizeof(mIndices[0]),
-	                      mIndexCount-mIndexOffset);
-	mVertexOffset = mVertexCount;
-	mIndexOffset = mIndexCount;
+	for (auto unit : units)
+	{
+		*v++ = { s.size * unit + s.pos,
+		         s.uvSize * unit + s.uvPos,
+		         s.color };
+	}
+	return v;
 }
 
 void
-Renderer::reserve(unsigned vcount, std::span<const std::uint16_t> indices)
+Renderer::createMesh(Mesh &mesh, std::span<const Sprite> sprites)
 {
-	auto base = mVertexCount - mVertexOffset;
-	if (base + vcount > UINT16_MAX)
+	if (!mesh.vao)
 	{
-		saveBatch();
-		base = 0;
+		glCheck(glGenVertexArrays(1, &mesh.vao));
+		glCheck(glGenBuffers(1, &mesh.vbo));
+		GLState::bindVertexArray(mesh.vao);
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+		glCheck(glEnableVertexAttribArray(0));
+		glCheck(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE,
+		                              sizeof(Vertex),
+		                              reinterpret_cast<GLvoid*>(offsetof(Vertex, pos))));
+		glCheck(glEnableVertexAttribArray(1));
+		glCheck(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE,
+		                              sizeof(Vertex),
+		                              reinterpret_cast<GLvoid*>(offsetof(Vertex, color))));
 	}
-	mVertexCount += vcount;
-	for (auto i : indices)
+
+	mMeshVertices.resize(sprites.size() * 4);
+	auto *v = mMeshVertices.data();
+	for (const auto &s : sprites)
 	{
-		mIndices.push_back(base + i);
+		v = writeQuad(v, s);
 	}
-	mIndexCount += indices.size();
+	mesh.quads = sprites.size();
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+	glCheck(glBufferData(GL_ARRAY_BUFFER,
+	                     mMeshVertices.size() * sizeof(mMeshVertices[0]),
+	                     mMeshVertices.data(),
+	                     GL_DYNAMIC_DRAW));
+	mStats.bytesUploaded += mMeshVertices.size() * sizeof(mMeshVertices[0]);
 }
 
 void
-Renderer::beginBatch()
+Renderer::updateMesh(const Mesh &mesh, unsigned first, std::span<const Sprite> sprites)
 {
-	mIndices.clear();
-	mBatches.clear();
-	mVertexOffset = mVertexCount = 0;
-	mIndexOffset = mIndexCount = 0;
+	assert(first + sprites.size() <= mesh.quads && "quads outside the mesh");
+
+	mMeshVertices.resize(sprites.size() * 4);
+	auto *v = mMeshVertices.data();
+	for (const auto &s : sprites)
+	{
+		v = writeQuad(v, s);
+	}
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+	glCheck(glBufferSubData(GL_ARRAY_BUFFER,
+	                        first * 4 * sizeof(Vertex),
+	                        mMeshVertices.size() * sizeof(mMeshVertices[0]),
+	                        mMeshVertices.data()));
+	mStats.bytesUploaded += mMeshVertices.size() * sizeof(mMeshVertices[0]);
 }
 
 void
-Renderer::endBatch()
+Renderer::destroyMesh(Mesh &mesh)
 {
-	saveBatch();
+	GLState::deleteVertexArray(mesh.vao);
+	GLState::deleteBuffer(mesh.vbo);
+	mesh = {};
 }
 
 void
-Renderer::drawBuffers() const
+Renderer::setBlend(Blend blend)
 {
-	// upload the indices
-	glCheck(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO));
-	glCheck(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-			     mIndices.size() * sizeof(mIndices[0]),
-			     mIndices.data(),
-			     GL_STREAM_DRAW));
+	switch (blend)
+	{
+	case Blend::Alpha:
+		GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		break;
+	case Blend::Additive:
+		GLState::blendFunc(GL_SRC_ALPHA, GL_ONE);
+		break;
+	}
+}
+
+void
+Renderer::flush()
+{
+	PROFILE_ZONE("Renderer::flush");
+	if (mCommands.empty())
+	{
+		return;
+	}
 
-	// draw all the batches
-	for (const auto &batch : mBatches)
+	// group the commands by state, the stable sort preserves
+	// the submission order of the commands with the same key
+	std::stable_sort(mCommands.begin(), mCommands.end(),
+	                 [](const auto &a, const auto &b) {
+		                 return a.key < b.key;
+	                 });
+
+	// expand the sprites in sorted order straight into the
+	// vertex stream: the commands with the same key end up
+	// adjacent in the vertex buffer
+	unsigned baseVertex = 0;
+	if (!mSprites.empty())
 	{
-		glCheck(glDrawElementsBaseVertex(
-			        GL_TRIANGLES,
-			        batch.indexCount,
-			        GL_UNSIGNED_SHORT,
-			        reinterpret_cast<GLvoid*>(batch.indexOffset),
-			        batch.vertexOffset));
+		auto *vertices = static_cast<Vertex*>(
+			mVertexStream.map(mSprites.size() * 4 * sizeof(Vertex),
+			                  sizeof(Vertex)));
+		auto *v = vertices;
+		for (auto &cmd : mCommands)
+		{
+			if (cmd.key.vertexArray != mVAO)
+			{
+				continue;
+			}
+			auto first = cmd.first;
+			cmd.first = (v - vertices) / 4;
+			for (unsigned i = first; i < first + cmd.count; ++i)
+			{
+				v = writeQuad(v, mSprites[i]);
+			}
+		}
+		baseVertex = mVertexStream.unmap() / sizeof(Vertex);
+		mStats.bytesUploaded += (v - vertices) * sizeof(Vertex);
+		GLState::bindVertexArray(mVAO);
+		bindVertexStream();
 	}
+
+	// draw each run of commands sharing the same state, the
+	// meshes are drawn one at a time from their own buffers
+	for (auto it = mCommands.begin(), end = mCommands.end(); it != end; )
+	{
+		auto run = it;
+		unsigned count = 0;
+		do
+		{
+			count += it->count;
+			++it;
+		}
+		while (it != end && it->key == run->key && run->key.vertexArray == mVAO);
+
+		GLint base = 0;
+		if (run->key.vertexArray == mVAO)
+		{
+			base = baseVertex;
+		}
+		run->shader->use();
+		run->texture.bind(0);
+		if (run->key.lookup != Texture2D::NoHandle)
+		{
+			run->lookup.bind(1);
+		}
+		if (run->shader == &mTilemapShader)
+		{
+			mTilemapUniforms.tileRect.setVector4f(run->tileRect);
+		}
+		setBlend(run->key.blend);
+		GLState::bindVertexArray(run->key.vertexArray);
+		for (unsigned first = run->first; count > 0; )
+		{
+			if (first != run->first)
+			{
+				mStats.splits++;
+			}
+			unsigned quads = std::min(count, MaxBatchQuads);
+			glCheck(glDrawElementsBaseVertex(
+				        GL_TRIANGLES,
+				        quads * std::size(indices),
+				        GL_UNSIGNED_SHORT,
+				        nullptr,
+				        base + first * 4));
+			mStats.drawCalls++;
+			mStats.batches++;
+			mStats.vertices += quads * 4;
+			mStats.indices += quads * std::size(indices);
+			first += quads;
+			count -= quads;
+		}
+	}
+
+	// restore the default blend function
+	setBlend(Blend::Alpha);
+
+	mSprites.clear();
+	mCommands.clear();
+}
+
+void
+Renderer::endFrame()
+{
+	flush();
+	mVertexStream.fence();
+
+	// the state changes are counted by the cache
+	const auto &state = GLState::getStats();
+	mStats.shaderSwitches = state.program.issued - mStateBaseline.program.issued;
+	mStats.textureBinds = state.texture.issued - mStateBaseline.texture.issued;
+	mStatsHistory[mFrameCount++ % StatsHistory] = mStats;
+	beginFrame();
+
+	// drop the strings not drawn lately, like the old values of
+	// the counters
+	if (mFrameCount % TextRunLifetime == 0)
+	{
+		auto stale = [&](const auto &entry) {
+			return mFrameCount - entry.second.lastFrame > TextRunLifetime;
+		};
+		for (auto &[font, runs] : mTextRuns)
+		{
+			std::erase_if(runs.utf8, stale);
+			std::erase_if(runs.utf32, stale);
+		}
+	}
+}
+
+void
+Renderer::beginFrame()
+{
+	mStats = {};
+	mStateBaseline = GLState::getStats();
+}
+
+const Renderer::Stats &
+Renderer::getStats(unsigned framesAgo) const
+{
+	static const Stats none{};
+	if (framesAgo >= std::min(mFrameCount, StatsHistory))
+	{
+		return none;
+	}
+	return mStatsHistory[(mFrameCount - 1 - framesAgo) % StatsHistory];
+}
+
+void
+Renderer::bindVertexStream()
+{
+	// the attribute pointers must follow the stream when it
+	// reallocates its buffer, mVAO is expected to be bound
+	if (mStreamVBO == mVertexStream.getHandle())
+	{
+		return;
+	}
+	mStreamVBO = mVertexStream.getHandle();
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mStreamVBO);
+	glCheck(glEnableVertexAttribArray(0));
+	glCheck(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE,
+	                              sizeof(Vertex),
+	                              reinterpret_cast<GLvoid*>(offsetof(Vertex, pos))));
+	glCheck(glEnableVertexAttribArray(1));
+	glCheck(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE,
+	                              sizeof(Vertex),
+	                              reinterpret_cast<GLvoid*>(offsetof(Vertex, color))));
 }
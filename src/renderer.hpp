@@ -1,87 +1,292 @@
 #pragma once
 
+#include <array>
+#include <compare>
 #include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "glstate.hpp"
+#include "postprocess.hpp"
 #include "shader.hpp"
+#include "streambuffer.hpp"
+#include "texture.hpp"
+#include "textureatlas.hpp"
 #include "entities.hpp"
 #include "resources.hpp"
 #include "resourceholder.hpp"
 
 class Font;
 class ParticleGen;
-class Postprocess;
-class Texture2D;
 
 class Renderer
 {
 public:
-	Renderer(unsigned screenWidth, unsigned screenHeight, const ShaderHolder &shaders);
+	// draw order of the queued sprites: lower layers are drawn
+	// first, inside a layer the sprites are grouped by state.
+	enum class Layer : std::uint8_t
+	{
+		Background,
+		Level,
+		Entities,
+		Particles,
+		Ball,
+		Text,
+	};
+
+	enum class Blend : std::uint8_t
+	{
+		Alpha,
+		Additive,
+	};
+
+	// how the level is drawn: a mesh with a quad per block or
+	// a single quad sampling a texture with a texel per block
+	enum class LevelMode
+	{
+		Auto,
+		Mesh,
+		Tilemap,
+	};
+
+	// work done by a frame
+	struct Stats
+	{
+		unsigned drawCalls;
+		// indexed draws of the sprites and meshes; a run longer
+		// than the 16-bit indices allow is split in more batches
+		unsigned batches;
+		unsigned splits;
+		unsigned vertices;
+		unsigned indices;
+		std::size_t bytesUploaded;
+		// state changes that reached the driver
+		unsigned shaderSwitches;
+		unsigned textureBinds;
+	};
+
+	static constexpr unsigned StatsHistory = 120;
+
+public:
+	// the projection maps the screen size, the postprocess passes
+	// work at the size of the framebuffer
+	Renderer(unsigned screenWidth, unsigned screenHeight,
+	         unsigned framebufferWidth, unsigned framebufferHeight,
+	         const ShaderHolder &shaders, const ShaderVariants &postShaders,
+	         const ShaderVariants &blurShaders);
 	~Renderer();
 
 	void clear(glm::vec4 color) const;
+	// the quads of the strings are cached, by their UTF-8 bytes or
+	// their codepoints: a string is decoded only when its run is built
 	void draw(const std::string &text, glm::vec2 pos,
 	          Font &font, glm::vec3 color = glm::vec3(1.0f));
+	void draw(std::u32string_view text, glm::vec2 pos,
+	          Font &font, glm::vec3 color = glm::vec3(1.0f));
 
 	void draw(const Paddle &player);
 	void draw(const Ball &ball);
 	void draw(const PowerUP &pow);
-	void draw(const Level &level);
+	void draw(Level &level);
 	void draw(const ParticleGen &pg);
-	void draw(const Postprocess &pp, float time);
+	void draw(Postprocess &pp, float time);
 
-	void draw(Texture2D texture, glm::vec2 pos, glm::vec2 size,
-	          glm::vec3 color = glm::vec3(1.0f));
-private:
+	void draw(const TextureRegion &texture, glm::vec2 pos, glm::vec2 size,
+	          glm::vec3 color = glm::vec3(1.0f),
+	          Layer layer = Layer::Entities);
+
+	// untextured rectangle
+	void drawRect(glm::vec2 pos, glm::vec2 size, glm::vec4 color,
+	              Layer layer = Layer::Text);
+
+	void setLevelMode(LevelMode mode);
+
+	// sort the queued sprites, upload them and draw them
+	void flush();
 
-	void reserve(unsigned vcount, std::span<const std::uint16_t> indices);
-	void beginBatch();
-	void endBatch();
-	void drawBuffers() const;
+	// reset the statistics of the frame
+	void beginFrame();
+	// flush and move the vertex stream to the next frame
+	void endFrame();
+
+	// statistics of a completed frame, 0 is the last one and
+	// the history goes back StatsHistory frames
+	const Stats &getStats(unsigned framesAgo = 0) const;
 
 private:
-	struct Batch
+	struct SortKey
 	{
-		unsigned vertexOffset;
-		unsigned indexOffset;
-		unsigned indexCount;
+		Layer layer;
+		GLuint program;
+		GLuint texture;
+		GLuint lookup;
+		Blend blend;
+		GLuint vertexArray;
+
+		auto operator<=>(const SortKey &other) const = default;
 	};
 
-	struct SimpleVertex
+	struct Sprite
 	{
 		glm::vec2 pos;
-		glm::vec2 uv;
+		glm::vec2 size;
+		glm::vec2 uvPos;
+		glm::vec2 uvSize;
+		glm::vec4 color;
+	};
+
+	struct Command
+	{
+		SortKey key;
+		const Shader *shader;
+		Texture2D texture;
+		Texture2D lookup;
+		unsigned first;
+		unsigned count;
+		// atlas region of the tiles, set when the run is drawn
+		glm::vec4 tileRect;
 	};
 
-	struct ColorVertex
+	struct Vertex
 	{
 		glm::vec2 pos;
 		glm::vec2 uv;
 		glm::vec4 color;
 	};
 
-	void saveBatch();
+	// std140 layout of the Frame uniform block shared by the
+	// programs
+	struct FrameUniforms
+	{
+		glm::mat4 projection;
+		GLfloat time;
+		GLfloat padding;
+		glm::vec2 sceneScale;
+	};
 
-	std::vector<Batch> mBatches;
-	std::vector<std::uint16_t> mIndices;
-	std::vector<SimpleVertex> mSimpleVertices;
-	std::vector<ColorVertex> mColorVertices;
-	unsigned mVertexOffset;
-	unsigned mVertexCount;
-	unsigned mIndexOffset;
-	unsigned mIndexCount;
+	// uniform locations resolved once after the link
+	struct PostUniforms
+	{
+		ShaderUniform scene;
+		ShaderUniform offsets;
+		ShaderUniform edgeKernel;
+	};
+
+	struct BlurUniforms
+	{
+		ShaderUniform image;
+		ShaderUniform taps;
+		ShaderUniform offsets;
+		ShaderUniform weights;
+	};
+
+	struct TilemapUniforms
+	{
+		ShaderUniform image;
+		ShaderUniform tiles;
+		ShaderUniform tileRect;
+	};
+
+	struct SpriteUniforms
+	{
+		ShaderUniform image;
+	};
+
+	// quads of a string relative to its origin, valid while the
+	// atlas of the font keeps its layout
+	struct TextRun
+	{
+		std::vector<Sprite> quads;
+		unsigned atlasVersion;
+		unsigned lastFrame;
+	};
+
+	struct TextHash
+	{
+		using is_transparent = void;
+		std::size_t operator()(std::string_view text) const noexcept;
+		std::size_t operator()(std::u32string_view text) const noexcept;
+	};
+
+	// the UTF-8 strings are keyed by their bytes: they are decoded
+	// only to build their run
+	struct TextRuns
+	{
+		std::unordered_map<std::string, TextRun, TextHash, std::equal_to<>> utf8;
+		std::unordered_map<std::u32string, TextRun, TextHash, std::equal_to<>> utf32;
+	};
+
+	// retained geometry living in its own vertex buffer
+	struct Mesh
+	{
+		GLuint vao;
+		GLuint vbo;
+		unsigned quads;
+	};
+
+	void push(Layer layer, const Shader &shader, Texture2D texture,
+	          Blend blend, const Sprite &sprite,
+	          Texture2D lookup = Texture2D());
+	void push(Layer layer, const Shader &shader, Texture2D texture,
+	          Blend blend, const Mesh &mesh);
+	void createMesh(Mesh &mesh, std::span<const Sprite> sprites);
+	void updateMesh(const Mesh &mesh, unsigned first, std::span<const Sprite> sprites);
+	void destroyMesh(Mesh &mesh);
+	static Vertex *writeQuad(Vertex *v, const Sprite &s);
+
+	template <typename Runs, typename Text>
+	const TextRun &getTextRun(Runs &runs, Text text, Font &font);
+	void draw(const TextRun &run, glm::vec2 pos, Font &font, glm::vec3 color);
+
+	void drawLevelMesh(const Level &level);
+	void drawLevelTilemap(const Level &level);
+	static Sprite getBlockSprite(const Level &level, const Block &block);
+	void setBlend(Blend blend);
+	void bindVertexStream();
+	void setBlurKernel(float sceneScale);
 
-	Shader mPostShader;
-	Shader mTextureShader;
-	Shader mUniformColorShader;
+private:
+	std::vector<Sprite> mSprites;
+	std::vector<Command> mCommands;
+	std::vector<Sprite> mMeshSprites;
+	std::vector<Vertex> mMeshVertices;
+	std::unordered_map<const Level *, Mesh> mLevelMeshes;
+	std::unordered_map<const Level *, Texture2D> mLevelTilemaps;
+	std::vector<std::uint8_t> mTiles;
+	std::unordered_map<const Font *, TextRuns> mTextRuns;
+	LevelMode mLevelMode;
+	Texture2D mWhite;
+	Stats mStats;
+	GLState::Stats mStateBaseline;
+	std::array<Stats, StatsHistory> mStatsHistory;
+	unsigned mFrameCount;
+
+	const ShaderVariants &mPostShaders;
+	const ShaderVariants &mBlurShaders;
+	Shader mTilemapShader;
 	Shader mVertexColorShader;
+	std::vector<PostUniforms> mPostUniforms;
+	std::vector<BlurUniforms> mBlurUniforms;
+	// passes of the postprocess chain for each mask of effects
+	std::vector<std::vector<Postprocess::Pass>> mPostChains;
+	// height of the blur targets and render scale of their kernel
+	unsigned mBlurHeight;
+	float mBlurSceneScale;
+	TilemapUniforms mTilemapUniforms;
+	SpriteUniforms mSpriteUniforms;
+
+	FrameUniforms mFrame;
+	GLuint mFrameUBO;
 
-	GLuint mSimpleVAO;
-	GLuint mColorVAO;
-	GLuint mVBO;
+	StreamBuffer mVertexStream;
+	GLuint mStreamVBO;
+	GLuint mVAO;
 	GLuint mEBO;
+	GLuint mQuadVAO;
+	GLuint mQuadVBO;
 };
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include "glcheck.hpp"
+#include "glstate.hpp"
+#include "rendertargetpool.hpp"
+
+RenderTargetPool::~RenderTargetPool()
+{
+	destroy();
+}
+
+RenderTarget *
+RenderTargetPool::acquire(unsigned width, unsigned height)
+{
+	for (auto &e : mEntries)
+	{
+		if (!e->used && e->target.width == width && e->target.height == height)
+		{
+			e->used = true;
+			return &e->target;
+		}
+	}
+
+	auto entry = std::make_unique<Entry>();
+	auto &t = entry->target;
+	t.width = width;
+	t.height = height;
+	glCheck(glGenFramebuffers(1, &t.fbo));
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, t.fbo);
+	t.texture.create(width, height, nullptr, true, true);
+	t.texture.attachToFramebuffer(0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		throw std::runtime_error("RenderTargetPool: Failed to initialize the FBO");
+	}
+	entry->used = true;
+	return &mEntries.emplace_back(std::move(entry))->target;
+}
+
+void
+RenderTargetPool::release(RenderTarget *target)
+{
+	auto found = std::find_if(mEntries.begin(), mEntries.end(), [&](const auto &e) {
+		return &e->target == target;
+	});
+	assert(found != mEntries.end() && (*found)->used && "target not acquired");
+	(*found)->used = false;
+}
+
+void
+RenderTargetPool::destroy()
+{
+	for (auto &e : mEntries)
+	{
+		GLState::deleteFramebuffer(e->target.fbo);
+		e->target.texture.destroy();
+	}
+	mEntries.clear();
+}
+
+std::size_t
+RenderTargetPool::getTargetCount() const noexcept
+{
+	return mEntries.size();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "texture.hpp"
+
+// color texture with its framebuffer
+struct RenderTarget
+{
+	GLuint fbo;
+	Texture2D texture;
+	unsigned width;
+	unsigned height;
+};
+
+// Recycles the render targets of the postprocess passes: a target
+// released by a pass is handed to the next pass asking for the same
+// size, so the targets that are not needed at the same time share
+// their memory. The targets are kept from a frame to the next.
+class RenderTargetPool
+{
+public:
+	RenderTargetPool() = default;
+	~RenderTargetPool();
+
+	RenderTargetPool(const RenderTargetPool &) = delete;
+	RenderTargetPool &operator=(const RenderTargetPool &) = delete;
+
+	RenderTarget *acquire(unsigned width, unsigned height);
+	void release(RenderTarget *target);
+	void destroy();
+
+	std::size_t getTargetCount() const noexcept;
+
+private:
+	struct Entry
+	{
+		RenderTarget target;
+		bool used;
+	};
+
+	std::vector<std::unique_ptr<Entry>> mEntries;
+};
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cmath>
+
+#include "resolutionscaler.hpp"
+
+namespace
+{
+// frames ignored after a change, longer than the latency of the
+// GPU timer queries
+static constexpr unsigned SettleFrames = 8;
+// weight of the last frame in the average
+static constexpr double Smoothing = 0.1;
+// the scale drops over the budget, aiming a bit under it, and
+// grows once the frames are well under it
+static constexpr double HighWater = 0.95;
+static constexpr double Aim = 0.85;
+static constexpr double LowWater = 0.7;
+static constexpr float GrowStep = 0.05f;
+}
+
+ResolutionScaler::ResolutionScaler()
+	: mBudget(1000.0 / 60.0)
+	, mAverage(0.0)
+	, mScale(MaxScale)
+	, mSettle(SettleFrames)
+{
+}
+
+void
+ResolutionScaler::setTargetFrameTime(double ms)
+{
+	mBudget = ms;
+}
+
+double
+ResolutionScaler::getTargetFrameTime() const
+{
+	return mBudget;
+}
+
+float
+ResolutionScaler::update(double ms)
+{
+	if (mSettle > 0)
+	{
+		// the measures of the new scale seed the average
+		mAverage = ms;
+		--mSettle;
+		return mScale;
+	}
+	mAverage += (ms - mAverage) * Smoothing;
+
+	auto scale = mScale;
+	if (mAverage > mBudget * HighWater)
+	{
+		scale *= static_cast<float>(std::sqrt(mBudget * Aim / mAverage));
+	}
+	else if (mAverage < mBudget * LowWater)
+	{
+		scale += GrowStep;
+	}
+	scale = std::clamp(scale, MinScale, MaxScale);
+
+	if (scale != mScale)
+	{
+		mScale = scale;
+		mSettle = SettleFrames;
+	}
+	return mScale;
+}
+
+float
+ResolutionScaler::getScale() const
+{
+	return mScale;
+}
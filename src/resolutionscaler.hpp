@@ -0,0 +1,31 @@
+#pragma once
+
+// Picks the resolution of the scene from the GPU time of the
+// frames to hold it under a budget. The cost of a frame is about
+// proportional to its pixels: over budget the scale drops at once
+// by the square root of the excess, with headroom it grows back in
+// small steps. The GPU times arrive a few frames late, after a
+// change the controller waits for the measures of the new scale.
+class ResolutionScaler
+{
+public:
+	static constexpr float MinScale = 0.5f;
+	static constexpr float MaxScale = 1.f;
+
+public:
+	ResolutionScaler();
+
+	// GPU time budget of a frame in milliseconds
+	void setTargetFrameTime(double ms);
+	double getTargetFrameTime() const;
+
+	// feed the GPU time of the last measured frame in milliseconds
+	float update(double ms);
+	float getScale() const;
+
+private:
+	double mBudget;
+	double mAverage;
+	float mScale;
+	unsigned mSettle;
+};
@@ -23,9 +23,7 @@ enum class TextureID
 
 enum class ShaderID
 {
-	Postprocess,
-	Texture,
-	UniformColor,
+	Tilemap,
 	VertexColor,
 };
 
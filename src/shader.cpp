@@ -1,3 +1,4 @@
+#include <cassert>
 #include <cstdlib>
 #include <iostream>
 
@@ -5,9 +6,36 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "glcheck.hpp"
+#include "glstate.hpp"
 #include "shader.hpp"
 #include "utility.hpp"
 
+namespace
+{
+// the defines and the shared header must follow the #version directive
+static std::string
+addPrologue(const std::string &source, const std::string &prologue)
+{
+	auto pos = source.find("#version");
+	if (pos == std::string::npos)
+	{
+		return prologue + source;
+	}
+	pos = source.find('\n', pos);
+	if (pos == std::string::npos)
+	{
+		return source + "\n" + prologue;
+	}
+	return source.substr(0, pos + 1) + prologue + source.substr(pos + 1);
+}
+
+static std::string
+loadHeader(const std::filesystem::path &header)
+{
+	return header.empty() ? std::string() : Utility::loadFile(header) + "\n";
+}
+}
+
 void
 ShaderUniform::setFloat(float value) const noexcept
 {
@@ -94,20 +122,23 @@ ShaderUniform::setMatrix4(const glm::mat4 &value) const noexcept
 
 bool
 Shader::loadFromFile(const std::filesystem::path &vs,
-                     const std::filesystem::path &fs) noexcept
+                     const std::filesystem::path &fs,
+                     const std::filesystem::path &header) noexcept
 {
+	auto prologue = loadHeader(header);
+
 	if (!mProgram)
 	{
 		mProgram = glCreateProgram();
 	}
 
-	if (!attachFile(Type::Vertex, vs.c_str()))
+	if (!attachFile(Type::Vertex, vs, prologue))
 	{
 		std::cerr << "Shader::loadFromFile() - cannot load "
 		          << vs.string() << std::endl;
 		return false;
 	}
-	if (!attachFile(Type::Fragment, fs.c_str()))
+	if (!attachFile(Type::Fragment, fs, prologue))
 	{
 		std::cerr << "Shader::loadFromFile() - cannot load "
 		          << fs.string() << std::endl;
@@ -136,14 +167,14 @@ Shader::create()
 void
 Shader::destroy()
 {
-	glDeleteProgram(mProgram);
+	GLState::deleteProgram(mProgram);
 	mProgram = 0;
 }
 
 void
 Shader::use() const noexcept
 {
-	glUseProgram(mProgram);
+	GLState::useProgram(mProgram);
 }
 
 bool
@@ -193,9 +224,10 @@ Shader::attachString(Shader::Type type, const std::string &source) const noexcep
 }
 
 bool
-Shader::attachFile(Shader::Type type, const std::filesystem::path &path) const
+Shader::attachFile(Shader::Type type, const std::filesystem::path &path,
+                   const std::string &prologue) const
 {
-	return attachString(type, Utility::loadFile(path));
+	return attachString(type, addPrologue(Utility::loadFile(path), prologue));
 }
 
 bool
@@ -228,6 +260,29 @@ Shader::getUniform(const std::string& name) const
 	return ShaderUniform(loc);
 }
 
+void
+Shader::bindUniformBlock(const std::string& name, unsigned binding) const
+{
+	GLuint index = glGetUniformBlockIndex(mProgram, name.c_str());
+	if (index == GL_INVALID_INDEX)
+	{
+		throw std::runtime_error("Shader::bindUniformBlock(\"" + name + "\") failed");
+	}
+	glCheck(glUniformBlockBinding(mProgram, index, binding));
+}
+
+ShaderUniform
+Shader::findUniform(const std::string& name) const noexcept
+{
+	return ShaderUniform(glGetUniformLocation(mProgram, name.c_str()));
+}
+
+bool
+Shader::hasUniformBlock(const std::string& name) const noexcept
+{
+	return glGetUniformBlockIndex(mProgram, name.c_str()) != GL_INVALID_INDEX;
+}
+
 ShaderAttrib
 Shader::getAttrib(const std::string& name) const
 {
@@ -238,3 +293,78 @@ Shader::getAttrib(const std::string& name) const
 	}
 	return ShaderAttrib(loc);
 }
+
+bool
+ShaderVariants::loadFromFile(const std::filesystem::path &vs,
+                             const std::filesystem::path &fs,
+                             const std::filesystem::path &header,
+                             const std::vector<std::string> &features,
+                             const std::function<unsigned(unsigned)> &reduce)
+{
+	auto vsSource = Utility::loadFile(vs);
+	auto fsSource = Utility::loadFile(fs);
+	auto prologue = loadHeader(header);
+
+	destroy();
+	const unsigned count = 1u << features.size();
+	mIndices.assign(count, count);
+	std::vector<unsigned> programs(count, count);
+	for (unsigned mask = 0; mask < count; ++mask)
+	{
+		auto variant = reduce ? reduce(mask) : mask;
+		assert(variant < count && "reduced mask out of range");
+		if (programs[variant] != count)
+		{
+			mIndices[mask] = programs[variant];
+			continue;
+		}
+
+		std::string defines;
+		for (std::size_t i = 0; i < features.size(); ++i)
+		{
+			if (variant & (1u << i))
+			{
+				defines += "#define " + features[i] + "\n";
+			}
+		}
+
+		auto &shader = mVariants.emplace_back();
+		if (!shader.create()
+		    || !shader.attachString(Shader::Type::Vertex, addPrologue(vsSource, defines + prologue))
+		    || !shader.attachString(Shader::Type::Fragment, addPrologue(fsSource, defines + prologue))
+		    || !shader.link())
+		{
+			std::cerr << "ShaderVariants::loadFromFile() - cannot build the variant "
+			          << variant << " of " << vs.string() << ", " << fs.string() << "\n";
+			destroy();
+			return false;
+		}
+		programs[variant] = mVariants.size() - 1;
+		mIndices[mask] = programs[variant];
+	}
+	return true;
+}
+
+void
+ShaderVariants::destroy()
+{
+	for (auto &shader : mVariants)
+	{
+		shader.destroy();
+	}
+	mVariants.clear();
+	mIndices.clear();
+}
+
+const Shader &
+ShaderVariants::get(unsigned mask) const
+{
+	assert(mask < mIndices.size() && "shader variant not found");
+	return mVariants[mIndices[mask]];
+}
+
+std::size_t
+ShaderVariants::size() const noexcept
+{
+	return mIndices.size();
+}
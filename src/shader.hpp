@@ -1,6 +1,10 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
 #include <glm/glm.hpp>
 
 class ShaderUniform
@@ -54,20 +58,56 @@ public:
 		Compute,
 	};
 
+	// header is inserted in both sources after the #version line
 	bool loadFromFile(const std::filesystem::path &vs,
-	                  const std::filesystem::path &fs) noexcept;
+	                  const std::filesystem::path &fs,
+	                  const std::filesystem::path &header = {}) noexcept;
 
 	bool create();
 	void destroy();
 
 	void use() const noexcept;
-	bool attachFile(Shader::Type type, const std::filesystem::path &path) const;
+	bool attachFile(Shader::Type type, const std::filesystem::path &path,
+	                const std::string &prologue = {}) const;
 	bool attachString(Shader::Type type, const std::string& source) const noexcept;
 	bool link() const noexcept;
 
 	ShaderUniform getUniform(const std::string& name) const;
+	// like getUniform() but a missing uniform is not an error:
+	// setting it does nothing
+	ShaderUniform findUniform(const std::string& name) const noexcept;
 	ShaderAttrib getAttrib(const std::string& name) const;
+	bool hasUniformBlock(const std::string& name) const noexcept;
+	void bindUniformBlock(const std::string& name, unsigned binding) const;
+
+	unsigned getHandle() const noexcept { return mProgram; }
 
 private:
 	unsigned mProgram = 0;
 };
+
+// Permutations of a program built from the same sources: the
+// variant at index mask is compiled with a #define for each of the
+// features whose bit is set in mask, so it contains only the code
+// of those features. When some features hide others, reduce maps a
+// mask to the one with the same code and the masks sharing it share
+// the program. The header follows the defines in both sources.
+class ShaderVariants
+{
+public:
+	bool loadFromFile(const std::filesystem::path &vs,
+	                  const std::filesystem::path &fs,
+	                  const std::filesystem::path &header,
+	                  const std::vector<std::string> &features,
+	                  const std::function<unsigned(unsigned)> &reduce = {});
+	void destroy();
+
+	const Shader &get(unsigned mask) const;
+	// number of masks, the programs can be fewer
+	std::size_t size() const noexcept;
+
+private:
+	std::vector<Shader> mVariants;
+	// program of each mask
+	std::vector<unsigned> mIndices;
+};
@@ -0,0 +1,208 @@
+#include <cassert>
+#include <stdexcept>
+
+#include "glcheck.hpp"
+#include "glstate.hpp"
+#include "streambuffer.hpp"
+
+namespace
+{
+static constexpr GLbitfield MapFlags =
+	GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+static inline std::size_t
+alignUp(std::size_t value, std::size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static void
+waitFence(GLsync &fence)
+{
+	if (!fence)
+	{
+		return;
+	}
+	for (;;)
+	{
+		GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+		                                 1000000000);
+		if (result != GL_TIMEOUT_EXPIRED)
+		{
+			break;
+		}
+	}
+	glCheck(glDeleteSync(fence));
+	fence = nullptr;
+}
+}
+
+StreamBuffer::StreamBuffer(GLenum target, std::size_t segmentSize, unsigned segments)
+	: mTarget(target)
+	, mBuffer(0)
+	, mPersistent(GLEW_ARB_buffer_storage)
+	, mMapped(nullptr)
+	, mFences(segments, nullptr)
+	, mSegmentSize(0)
+	, mSegment(0)
+	, mOffset(0)
+	, mMapOffset(0)
+	, mMapSize(0)
+{
+	assert(segments > 0 && "at least one segment is needed");
+	allocate(segmentSize);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	release();
+}
+
+void
+StreamBuffer::allocate(std::size_t segmentSize)
+{
+	release();
+
+	mSegmentSize = segmentSize;
+	mSegment = 0;
+	mOffset = 0;
+
+	auto size = mSegmentSize * mFences.size();
+	glCheck(glGenBuffers(1, &mBuffer));
+	GLState::bindBuffer(mTarget, mBuffer);
+	if (mPersistent)
+	{
+		glCheck(glBufferStorage(mTarget, size, nullptr, MapFlags));
+		mMapped = static_cast<std::uint8_t *>(
+			glMapBufferRange(mTarget, 0, size, MapFlags));
+		if (!mMapped)
+		{
+			throw std::runtime_error("StreamBuffer::allocate() - "
+			                         "cannot map the buffer");
+		}
+	}
+	else
+	{
+		glCheck(glBufferData(mTarget, size, nullptr, GL_STREAM_DRAW));
+	}
+}
+
+void
+StreamBuffer::release()
+{
+	for (auto &fence : mFences)
+	{
+		if (fence)
+		{
+			glCheck(glDeleteSync(fence));
+			fence = nullptr;
+		}
+	}
+	if (mBuffer)
+	{
+		if (mMapped)
+		{
+			GLState::bindBuffer(mTarget, mBuffer);
+			glCheck(glUnmapBuffer(mTarget));
+			mMapped = nullptr;
+		}
+		GLState::deleteBuffer(mBuffer);
+		mBuffer = 0;
+	}
+}
+
+void
+StreamBuffer::nextSegment()
+{
+	if (mPersistent)
+	{
+		// protect the segment we have just written and wait
+		// for the GPU to release the next one
+		mFences[mSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mSegment = (mSegment + 1) % mFences.size();
+		waitFence(mFences[mSegment]);
+	}
+	else
+	{
+		mSegment = (mSegment + 1) % mFences.size();
+		if (mSegment == 0)
+		{
+			// orphan the storage, the driver will hand
+			// us a fresh one without waiting for the GPU
+			GLState::bindBuffer(mTarget, mBuffer);
+			glCheck(glBufferData(mTarget, mSegmentSize * mFences.size(),
+			                     nullptr, GL_STREAM_DRAW));
+		}
+	}
+	mOffset = 0;
+}
+
+void *
+StreamBuffer::map(std::size_t size, std::size_t alignment)
+{
+	assert(mMapSize == 0 && "StreamBuffer::map() called twice");
+
+	auto offset = alignUp(mOffset, alignment);
+	if (offset + size > mSegmentSize)
+	{
+		if (size > mSegmentSize)
+		{
+			// grow the ring, the old buffer is released by
+			// the driver when the GPU is done with it
+			auto segmentSize = mSegmentSize;
+			while (segmentSize < size)
+			{
+				segmentSize *= 2;
+			}
+			allocate(alignUp(segmentSize, alignment));
+		}
+		else
+		{
+			nextSegment();
+		}
+		offset = 0;
+	}
+
+	mMapOffset = mSegment * mSegmentSize + offset;
+	mMapSize = size;
+	mOffset = offset + size;
+	if (mPersistent)
+	{
+		return mMapped + mMapOffset;
+	}
+	mStaging.resize(size);
+	return mStaging.data();
+}
+
+std::size_t
+StreamBuffer::unmap()
+{
+	if (!mPersistent && mMapSize > 0)
+	{
+		GLState::bindBuffer(mTarget, mBuffer);
+		glCheck(glBufferSubData(mTarget, mMapOffset, mMapSize, mStaging.data()));
+	}
+	mMapSize = 0;
+	return mMapOffset;
+}
+
+void
+StreamBuffer::fence()
+{
+	if (mOffset > 0)
+	{
+		nextSegment();
+	}
+}
+
+GLuint
+StreamBuffer::getHandle() const noexcept
+{
+	return mBuffer;
+}
+
+bool
+StreamBuffer::isPersistent() const noexcept
+{
+	return mPersistent;
+}
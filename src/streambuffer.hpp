@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Ring of buffer segments used to stream the dynamic geometry.
+//
+// With ARB_buffer_storage the buffer is persistently mapped and
+// the caller writes directly into it; each segment is protected by
+// a fence so that the CPU never overwrites data the GPU is still
+// reading. Without it the data is written in a staging area and
+// uploaded with glBufferSubData(), orphaning the buffer each time
+// the ring wraps around.
+class StreamBuffer
+{
+public:
+	StreamBuffer(GLenum target, std::size_t segmentSize, unsigned segments = 3);
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer &) = delete;
+	StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+	// reserve size bytes aligned to alignment and return the
+	// pointer to write them to; unmap() returns their offset in
+	// the buffer.
+	void *map(std::size_t size, std::size_t alignment);
+	std::size_t unmap();
+
+	// mark the end of the frame: the next frame will use the
+	// next segment of the ring.
+	void fence();
+
+	GLuint getHandle() const noexcept;
+	bool isPersistent() const noexcept;
+
+private:
+	void allocate(std::size_t segmentSize);
+	void release();
+	void nextSegment();
+
+	GLenum mTarget;
+	GLuint mBuffer;
+	bool mPersistent;
+	std::uint8_t *mMapped;
+	std::vector<std::uint8_t> mStaging;
+	std::vector<GLsync> mFences;
+	std::size_t mSegmentSize;
+	unsigned mSegment;
+	std::size_t mOffset;
+	std::size_t mMapOffset;
+	std::size_t mMapSize;
+};
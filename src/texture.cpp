@@ -2,11 +2,40 @@
 #include <iostream>
 
 #include "glcheck.hpp"
+#include "glstate.hpp"
 #include "texture.hpp"
 #include "stb_image.h"
 
+namespace
+{
+struct FormatInfo
+{
+	GLenum internal;
+	GLenum format;
+	GLint alignment;
+};
+
+static FormatInfo
+getFormatInfo(Texture2D::Format format)
+{
+	switch (format)
+	{
+	case Texture2D::Format::Red:
+		return { GL_R8, GL_RED, 1 };
+	case Texture2D::Format::RGBA:
+	default:
+		return { GL_RGBA8, GL_RGBA, 4 };
+	}
+}
+}
+
 Texture2D::Texture2D()
-	: glHandle(-1U)
+	: glHandle(NoHandle)
+	, mWidth(0)
+	, mHeight(0)
+	, mFormat(Format::RGBA)
+	, mRepeat(false)
+	, mSmooth(true)
 {
 }
 
@@ -33,7 +62,8 @@ Texture2D::loadFromFile(const std::filesystem::path &path)
 }
 
 bool
-Texture2D::create(unsigned width, unsigned height, const void *pixels, bool repeat, bool smooth) noexcept
+Texture2D::create(unsigned width, unsigned height, const void *pixels,
+                  bool repeat, bool smooth, Format format) noexcept
 {
 	if (!width || !height)
 	{
@@ -42,12 +72,12 @@ Texture2D::create(unsigned width, unsigned height, const void *pixels, bool repe
 		return false;
 	}
 
-	if (glHandle == -1U)
+	if (glHandle == NoHandle)
 	{
 		glCheck(glGenTextures(1, &glHandle));
 	}
 
-	glCheck(glBindTexture(GL_TEXTURE_2D, glHandle));
+	GLState::bindTexture(glHandle);
 	GLint param = repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE;
 	glCheck(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, param));
 	glCheck(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, param));
@@ -56,11 +86,19 @@ Texture2D::create(unsigned width, unsigned height, const void *pixels, bool repe
 	glCheck(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, param));
 	glCheck(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, param));
 
-	glCheck(glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height));
+	mWidth = width;
+	mHeight = height;
+	mFormat = format;
+	mRepeat = repeat;
+	mSmooth = smooth;
+	auto info = getFormatInfo(mFormat);
+	glCheck(glTexStorage2D(GL_TEXTURE_2D, 1, info.internal, width, height));
 	if (pixels)
 	{
-		glCheck(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA,
+		glCheck(glPixelStorei(GL_UNPACK_ALIGNMENT, info.alignment));
+		glCheck(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, info.format,
 		                        GL_UNSIGNED_BYTE, pixels));
+		glCheck(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
 	}
 	return true;
 }
@@ -80,19 +118,21 @@ Texture2D::update(const void *pixels,
 	assert(y + h <= getHeight() && "Y target outside the texture");
 	assert(pixels != nullptr && "empty bitmap");
 
-	if (glHandle != -1U)
+	if (glHandle != NoHandle)
 	{
-		glCheck(glBindTexture(GL_TEXTURE_2D, glHandle));
+		auto info = getFormatInfo(mFormat);
+		GLState::bindTexture(glHandle);
+		glCheck(glPixelStorei(GL_UNPACK_ALIGNMENT, info.alignment));
 		glCheck(glTexSubImage2D(GL_TEXTURE_2D,
 		                        0,
 		                        static_cast<GLint>(x),
 		                        static_cast<GLint>(y),
 		                        static_cast<GLsizei>(w),
 		                        static_cast<GLsizei>(h),
-		                        GL_RGBA,
+		                        info.format,
 		                        GL_UNSIGNED_BYTE,
 		                        pixels));
-		glCheck(glFlush());
+		glCheck(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
 	}
 }
 
@@ -105,7 +145,7 @@ Texture2D::update(const Texture2D &other, unsigned x, unsigned y)
 	auto srcHeight = other.getHeight();
 	assert(x + srcWidth <= dstWidth && "X target outside the texture");
 	assert(y + srcHeight <= dstHeight && "Y target outside the texture");
-	if (glHandle == -1U || other.glHandle == -1U)
+	if (glHandle == NoHandle || other.glHandle == NoHandle)
 	{
 		return;
 	}
@@ -118,14 +158,14 @@ Texture2D::update(const Texture2D &other, unsigned x, unsigned y)
 	glCheck(glGenFramebuffers(1, &readFB));
 	glCheck(glGenFramebuffers(1, &drawFB));
 
-	glCheck(glBindFramebuffer(GL_READ_FRAMEBUFFER, readFB));
+	GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, readFB);
 	glCheck(glFramebufferTexture2D(GL_READ_FRAMEBUFFER,
 	                               GL_COLOR_ATTACHMENT0,
 	                               GL_TEXTURE_2D,
 	                               other.glHandle,
 	                               0));
 
-	glCheck(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFB));
+	GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFB);
 	glCheck(glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER,
 	                               GL_COLOR_ATTACHMENT0,
 	                               GL_TEXTURE_2D,
@@ -147,34 +187,50 @@ Texture2D::update(const Texture2D &other, unsigned x, unsigned y)
 		        GL_COLOR_BUFFER_BIT,
 		        GL_NEAREST));
 
-	glCheck(glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFB));
-	glCheck(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFB));
+	GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFB);
+	GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFB);
 
-	glCheck(glDeleteFramebuffers(1, &readFB));
-	glCheck(glDeleteFramebuffers(1, &drawFB));
+	GLState::deleteFramebuffer(readFB);
+	GLState::deleteFramebuffer(drawFB);
+}
+
+void
+Texture2D::download(void *pixels) const
+{
+	assert(pixels != nullptr && "empty bitmap");
+	if (glHandle == NoHandle)
+	{
+		return;
+	}
+
+	auto info = getFormatInfo(mFormat);
+	GLState::bindTexture(glHandle);
+	glCheck(glPixelStorei(GL_PACK_ALIGNMENT, info.alignment));
+	glCheck(glGetTexImage(GL_TEXTURE_2D, 0, info.format, GL_UNSIGNED_BYTE, pixels));
+	glCheck(glPixelStorei(GL_PACK_ALIGNMENT, 4));
 }
 
 void
 Texture2D::destroy() noexcept
 {
-	if (glHandle != -1U)
+	if (glHandle != NoHandle)
 	{
-		glCheck(glDeleteTextures(1, &glHandle));
-		glHandle = -1U;
+		GLState::deleteTexture(glHandle);
+		glHandle = NoHandle;
+		mWidth = mHeight = 0;
 	}
 }
 
 void
 Texture2D::bind() const noexcept
 {
-	glCheck(glBindTexture(GL_TEXTURE_2D, glHandle));
+	GLState::bindTexture(glHandle);
 }
 
 void
 Texture2D::bind(int textureUnit) const noexcept
 {
-	glCheck(glActiveTexture(GL_TEXTURE0 + textureUnit));
-	glCheck(glBindTexture(GL_TEXTURE_2D, glHandle));
+	GLState::bindTexture(textureUnit, glHandle);
 }
 
 void
@@ -187,25 +243,29 @@ Texture2D::attachToFramebuffer(int level) const noexcept
 unsigned
 Texture2D::getWidth() const noexcept
 {
-	GLint width = 0;
-	if (glHandle != -1U)
-	{
-		glCheck(glBindTexture(GL_TEXTURE_2D, glHandle));
-		glCheck(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0,
-		                                 GL_TEXTURE_WIDTH, &width));
-	}
-	return width;
+	return mWidth;
 }
 
 unsigned
 Texture2D::getHeight() const noexcept
 {
-	GLint height = 0;
-	if (glHandle != -1U)
-	{
-		glCheck(glBindTexture(GL_TEXTURE_2D, glHandle));
-		glCheck(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0,
-		                                 GL_TEXTURE_HEIGHT, &height));
-	}
-	return height;
+	return mHeight;
+}
+
+Texture2D::Format
+Texture2D::getFormat() const noexcept
+{
+	return mFormat;
+}
+
+bool
+Texture2D::isRepeated() const noexcept
+{
+	return mRepeat;
+}
+
+bool
+Texture2D::isSmooth() const noexcept
+{
+	return mSmooth;
 }
@@ -5,13 +5,24 @@
 
 class Texture2D
 {
+public:
+	enum class Format
+	{
+		RGBA,
+		Red,
+	};
+
+	// handle of a texture not created yet
+	static constexpr GLuint NoHandle = -1U;
+
 public:
 	Texture2D();
 
 	bool loadFromFile(const std::filesystem::path &path);
 	bool create(unsigned width, unsigned height,
 	            const void *pixels=nullptr,
-	            bool repeat=false, bool smooth=true) noexcept;
+	            bool repeat=false, bool smooth=true,
+	            Format format=Format::RGBA) noexcept;
 
 	void update(const void *pixels);
 	void update(const void *pixels,
@@ -19,6 +30,8 @@ public:
 	            unsigned w, unsigned h);
 	void update(const Texture2D &other,
 	            unsigned x=0, unsigned y=0);
+	// copy the pixels back, in the format of the texture
+	void download(void *pixels) const;
 
 	void destroy() noexcept;
 
@@ -26,9 +39,21 @@ public:
 	void bind(int textureUnit) const noexcept;
 	void attachToFramebuffer(int level) const noexcept;
 
+	// the metadata is recorded by create(): the queries don't
+	// touch the GL state
 	unsigned getWidth() const noexcept;
 	unsigned getHeight() const noexcept;
+	Format getFormat() const noexcept;
+	bool isRepeated() const noexcept;
+	bool isSmooth() const noexcept;
+
+	GLuint getHandle() const noexcept { return glHandle; }
 
 private:
 	GLuint glHandle;
+	unsigned mWidth;
+	unsigned mHeight;
+	Format mFormat;
+	bool mRepeat;
+	bool mSmooth;
 };
@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "stb_image.h"
+#include "textureatlas.hpp"
+
+namespace
+{
+// the borders of each image are extruded in the padding to avoid
+// bleeding of the neighbours with linear filtering
+const int PADDING = 2;
+
+static inline unsigned
+roundUp2(unsigned v)
+{
+	v--;
+	v |= v >> 1;
+	v |= v >> 2;
+	v |= v >> 4;
+	v |= v >> 8;
+	v |= v >> 16;
+	return v + 1;
+}
+}
+
+bool
+TextureAtlas::add(TextureID id, const std::filesystem::path &path)
+{
+	int width, height, channels;
+	auto *pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
+	if (pixels == nullptr)
+	{
+		std::cerr << "TextureAtlas::add() - Cannot load " << path.string()
+		          << std::endl;
+		return false;
+	}
+
+	auto &image = mImages.emplace_back();
+	image.id = id;
+	image.width = width;
+	image.height = height;
+	image.pixels.assign(pixels, pixels + width * height * 4);
+	stbi_image_free(pixels);
+	return true;
+}
+
+bool
+TextureAtlas::place(unsigned width, unsigned &height)
+{
+	// shelf packing, the images are sorted by decreasing height
+	unsigned x = 0;
+	unsigned y = 0;
+	unsigned shelfHeight = 0;
+	for (auto &image : mImages)
+	{
+		unsigned w = image.width + 2 * PADDING;
+		unsigned h = image.height + 2 * PADDING;
+		if (w > width)
+		{
+			return false;
+		}
+		if (x + w > width)
+		{
+			x = 0;
+			y += shelfHeight;
+			shelfHeight = 0;
+		}
+		image.x = x + PADDING;
+		image.y = y + PADDING;
+		x += w;
+		shelfHeight = std::max(shelfHeight, h);
+	}
+	height = roundUp2(y + shelfHeight);
+	return true;
+}
+
+bool
+TextureAtlas::pack(unsigned maxSize)
+{
+	if (mImages.empty())
+	{
+		std::cerr << "TextureAtlas::pack() - no images to pack\n";
+		return false;
+	}
+
+	std::sort(mImages.begin(), mImages.end(), [](const auto &a, const auto &b) {
+		return a.height > b.height;
+	});
+
+	// find the power of two size with the smallest area
+	unsigned bestWidth = 0;
+	unsigned bestHeight = 0;
+	for (unsigned width = 64; width <= maxSize; width *= 2)
+	{
+		unsigned height;
+		if (!place(width, height) || height > maxSize)
+		{
+			continue;
+		}
+		if (!bestWidth || width * height < bestWidth * bestHeight)
+		{
+			bestWidth = width;
+			bestHeight = height;
+		}
+	}
+	if (!bestWidth)
+	{
+		std::cerr << "TextureAtlas::pack() - the images don't fit in "
+		          << maxSize << "x" << maxSize << "\n";
+		return false;
+	}
+	place(bestWidth, bestHeight);
+
+	// compose the atlas on the CPU and upload it at once
+	std::vector<std::uint8_t> pixels(bestWidth * bestHeight * 4, 0);
+	auto texel = [&](int x, int y) {
+		return pixels.data() + (y * bestWidth + x) * 4;
+	};
+	for (const auto &image : mImages)
+	{
+		int width = image.width;
+		int height = image.height;
+		for (int y = 0; y < height + 2 * PADDING; ++y)
+		{
+			int srcY = std::clamp(y - PADDING, 0, height - 1);
+			for (int x = 0; x < width + 2 * PADDING; ++x)
+			{
+				int srcX = std::clamp(x - PADDING, 0, width - 1);
+				std::memcpy(texel(image.x - PADDING + x, image.y - PADDING + y),
+				            image.pixels.data() + (srcY * image.width + srcX) * 4,
+				            4);
+			}
+		}
+	}
+
+	if (!mTexture.create(bestWidth, bestHeight, pixels.data()))
+	{
+		std::cerr << "TextureAtlas::pack() - cannot create the texture\n";
+		return false;
+	}
+
+	glm::vec2 size(bestWidth, bestHeight);
+	mRegions.clear();
+	for (const auto &image : mImages)
+	{
+		mRegions.emplace(image.id, TextureRegion(
+			                 mTexture,
+			                 glm::vec2(image.x, image.y) / size,
+			                 glm::vec2(image.width, image.height) / size));
+	}
+	mImages.clear();
+	return true;
+}
+
+void
+TextureAtlas::destroy()
+{
+	mTexture.destroy();
+	mRegions.clear();
+	mImages.clear();
+}
+
+const TextureRegion &
+TextureAtlas::get(TextureID id) const
+{
+	auto found = mRegions.find(id);
+	assert(found != mRegions.end() && "Region not found");
+	return found->second;
+}
+
+const Texture2D &
+TextureAtlas::getTexture() const
+{
+	return mTexture;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "resources.hpp"
+#include "texture.hpp"
+
+// rectangle of a texture in normalized coordinates
+struct TextureRegion
+{
+	TextureRegion() = default;
+	TextureRegion(Texture2D texture)
+		: texture(texture), uvPos(0.f), uvSize(1.f)
+	{
+	}
+	TextureRegion(Texture2D texture, glm::vec2 uvPos, glm::vec2 uvSize)
+		: texture(texture), uvPos(uvPos), uvSize(uvSize)
+	{
+	}
+
+	Texture2D texture;
+	glm::vec2 uvPos;
+	glm::vec2 uvSize;
+};
+
+// Packs many images in a single texture so that the sprites using
+// them can be drawn without switching texture.
+class TextureAtlas
+{
+public:
+	bool add(TextureID id, const std::filesystem::path &path);
+	bool pack(unsigned maxSize = 4096);
+	void destroy();
+
+	const TextureRegion &get(TextureID id) const;
+	const Texture2D &getTexture() const;
+
+private:
+	struct Image
+	{
+		TextureID id;
+		unsigned width;
+		unsigned height;
+		std::vector<std::uint8_t> pixels;
+		unsigned x;
+		unsigned y;
+	};
+
+	bool place(unsigned width, unsigned &height);
+
+	std::vector<Image> mImages;
+	std::unordered_map<TextureID, TextureRegion> mRegions;
+	Texture2D mTexture;
+};
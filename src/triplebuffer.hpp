@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Hands values from a writer thread to a reader thread without
+// locks: the writer fills the back slot and publishes it, the
+// reader takes the newest published slot. Neither side waits and
+// the reader skips the values published in the meantime.
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer();
+
+	// writer side
+	T &getBack();
+	// returns false when the previous value was never acquired:
+	// the back slot then holds it again
+	bool publish();
+
+	// reader side, false when nothing new was published
+	bool acquire();
+	const T &getFront() const;
+
+private:
+	// set in mMiddle when it holds a value not acquired yet
+	static constexpr unsigned Fresh = 4;
+	static constexpr unsigned IndexMask = 3;
+
+	std::array<T, 3> mSlots;
+	alignas(64) unsigned mBack;
+	alignas(64) unsigned mFront;
+	alignas(64) std::atomic<unsigned> mMiddle;
+};
+
+template <typename T>
+TripleBuffer<T>::TripleBuffer()
+	: mSlots()
+	, mBack(0)
+	, mFront(1)
+	, mMiddle(2)
+{
+}
+
+template <typename T>
+T &
+TripleBuffer<T>::getBack()
+{
+	return mSlots[mBack];
+}
+
+template <typename T>
+bool
+TripleBuffer<T>::publish()
+{
+	auto old = mMiddle.exchange(mBack | Fresh, std::memory_order_acq_rel);
+	mBack = old & IndexMask;
+	return !(old & Fresh);
+}
+
+template <typename T>
+bool
+TripleBuffer<T>::acquire()
+{
+	if (!(mMiddle.load(std::memory_order_relaxed) & Fresh))
+	{
+		return false;
+	}
+	auto old = mMiddle.exchange(mFront, std::memory_order_acq_rel);
+	mFront = old & IndexMask;
+	return true;
+}
+
+template <typename T>
+const T &
+TripleBuffer<T>::getFront() const
+{
+	return mSlots[mFront];
+}
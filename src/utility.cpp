@@ -1,5 +1,7 @@
+#include <array>
 #include <fstream>
 #include <sstream>
+#include <vector>
 
 #include "utility.hpp"
 
@@ -42,6 +44,52 @@ decode(uint32_t* state, uint32_t* codep, uint32_t byte)
 	return *state;
 }
 
+// PNG chunk checksum
+uint32_t
+crc32(const uint8_t *data, std::size_t size, uint32_t crc = 0)
+{
+	static const auto table = [] {
+		std::array<uint32_t, 256> t{};
+		for (uint32_t n = 0; n < 256; ++n)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; ++k)
+			{
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			t[n] = c;
+		}
+		return t;
+	}();
+
+	crc = ~crc;
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+void
+putU32(std::vector<uint8_t> &out, uint32_t value)
+{
+	out.push_back(value >> 24);
+	out.push_back(value >> 16);
+	out.push_back(value >> 8);
+	out.push_back(value);
+}
+
+void
+writeChunk(std::ostream &out, const char *type, const std::vector<uint8_t> &data)
+{
+	std::vector<uint8_t> chunk;
+	putU32(chunk, data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putU32(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+	out.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
 }
 
 namespace Utility
@@ -80,4 +128,65 @@ std::u32string decodeUTF8(std::string_view str)
 	return out;
 }
 
+bool savePNG(const std::filesystem::path &path,
+             unsigned width, unsigned height,
+             const std::uint8_t *pixels)
+{
+	std::ofstream out(path, std::ios::out|std::ios::binary);
+	if (!out)
+	{
+		return false;
+	}
+	static const uint8_t signature[] = {
+		0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+	};
+	out.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+	// 8 bit RGBA, no interlacing
+	std::vector<uint8_t> header;
+	putU32(header, width);
+	putU32(header, height);
+	header.insert(header.end(), {8, 6, 0, 0, 0});
+	writeChunk(out, "IHDR", header);
+
+	// scanlines without filtering, in a zlib stream made of
+	// stored deflate blocks
+	std::vector<uint8_t> raw;
+	std::size_t stride = width * 4;
+	raw.reserve((stride + 1) * height);
+	for (unsigned y = 0; y < height; ++y)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), pixels + y * stride, pixels + (y + 1) * stride);
+	}
+
+	std::vector<uint8_t> data = {0x78, 0x01};
+	std::size_t offset = 0;
+	do
+	{
+		std::size_t size = std::min<std::size_t>(raw.size() - offset, 0xffff);
+		bool last = offset + size == raw.size();
+		data.push_back(last ? 1 : 0);
+		data.push_back(size);
+		data.push_back(size >> 8);
+		data.push_back(~size);
+		data.push_back(~size >> 8);
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+		offset += size;
+	}
+	while (offset < raw.size());
+
+	uint32_t a = 1, b = 0;
+	for (auto byte : raw)
+	{
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	putU32(data, (b << 16) | a);
+	writeChunk(out, "IDAT", data);
+	writeChunk(out, "IEND", {});
+
+	return bool(out);
+}
+
 }
@@ -1,10 +1,17 @@
 #pragma once
 
 #include <filesystem>
+#include <cstdint>
 #include <string>
 
 namespace Utility
 {
 std::string loadFile(const std::filesystem::path &path);
 std::u32string decodeUTF8(std::string_view str);
+
+// write 8 bit RGBA pixels, rows from top to bottom, to an
+// uncompressed PNG file
+bool savePNG(const std::filesystem::path &path,
+             unsigned width, unsigned height,
+             const std::uint8_t *pixels);
 }